@@ -0,0 +1,656 @@
+#include <math.h>
+#include <string.h>
+
+// Vector paths are picked at compile time. Building with -mavx2 (or -march=native on a capable
+// machine) enables the 256-bit paths, SSE2 is always there on x86_64, anything else gets the scalar loops
+#if defined(__AVX2__)
+	#include <immintrin.h>
+#elif defined(__SSE2__)
+	#include <emmintrin.h>
+#endif
+
+#include <aul/common.h>
+
+#include <array.h>
+
+typedef union
+{
+	bool b;
+	int i;
+	double d;
+} scratch_t;
+
+typedef void (*convert_f)(void * to, const void * from, size_t nelems);
+
+
+static const void * readspan(const array_t * array, size_t offset, size_t end, size_t elemsize, scratch_t * scratch, size_t * count)
+{
+	bufferpos_t pos;
+	bufferpos_new(&pos, (array_t *)array, offset);
+
+	size_t length = min(bufferpos_span(&pos), end - offset);
+	if likely(length >= elemsize)
+	{
+		*count = length / elemsize;
+		return buffer_peek(&pos, *count * elemsize);
+	}
+
+	// The element straddles a page boundary, read it the slow way
+	buffer_read(array, scratch, offset, elemsize);
+	*count = 1;
+	return scratch;
+}
+
+static void * writespan(array_t * array, size_t offset, size_t end, size_t elemsize, scratch_t * scratch, size_t * count)
+{
+	bufferpos_t pos;
+	bufferpos_new(&pos, array, offset);
+
+	size_t length = min(bufferpos_span(&pos), end - offset);
+	if likely(length >= elemsize)
+	{
+		*count = length / elemsize;
+
+		void * span = buffer_reserve(&pos, *count * elemsize);
+		if likely(span != NULL)
+		{
+			return span;
+		}
+	}
+
+	// The element straddles a page boundary (or a small buffer needs to grow), go through the scratch element
+	memset(scratch, 0, sizeof(scratch_t));
+	buffer_read(array, scratch, offset, elemsize);
+	*count = 1;
+	return scratch;
+}
+
+static bool writedone(array_t * array, size_t offset, const void * span, size_t count, size_t elemsize, const scratch_t * scratch)
+{
+	if (span == scratch)
+	{
+		return buffer_write(array, scratch, offset, elemsize) == elemsize;
+	}
+
+	bufferpos_t pos;
+	bufferpos_new(&pos, array, offset);
+	buffer_commit(&pos, count * elemsize);
+	return true;
+}
+
+static double sum_doubles(const double * v, size_t n, double sum)
+{
+	size_t i = 0;
+
+#if defined(__AVX2__)
+	__m256d a0 = _mm256_setzero_pd(), a1 = _mm256_setzero_pd();
+	for (; i + 8 <= n; i += 8)
+	{
+		a0 = _mm256_add_pd(a0, _mm256_loadu_pd(&v[i]));
+		a1 = _mm256_add_pd(a1, _mm256_loadu_pd(&v[i + 4]));
+	}
+
+	double lanes[4];
+	_mm256_storeu_pd(lanes, _mm256_add_pd(a0, a1));
+	sum += (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+#elif defined(__SSE2__)
+	__m128d a0 = _mm_setzero_pd(), a1 = _mm_setzero_pd();
+	for (; i + 4 <= n; i += 4)
+	{
+		a0 = _mm_add_pd(a0, _mm_loadu_pd(&v[i]));
+		a1 = _mm_add_pd(a1, _mm_loadu_pd(&v[i + 2]));
+	}
+
+	double lanes[2];
+	_mm_storeu_pd(lanes, _mm_add_pd(a0, a1));
+	sum += lanes[0] + lanes[1];
+#endif
+
+	for (; i < n; i++)
+	{
+		sum += v[i];
+	}
+
+	return sum;
+}
+
+static double min_doubles(const double * v, size_t n, double m)
+{
+	size_t i = 0;
+
+#if defined(__AVX2__)
+	__m256d vm = _mm256_set1_pd(m);
+	for (; i + 4 <= n; i += 4)
+	{
+		vm = _mm256_min_pd(vm, _mm256_loadu_pd(&v[i]));
+	}
+
+	double lanes[4];
+	_mm256_storeu_pd(lanes, vm);
+	m = min(min(lanes[0], lanes[1]), min(lanes[2], lanes[3]));
+#elif defined(__SSE2__)
+	__m128d vm = _mm_set1_pd(m);
+	for (; i + 2 <= n; i += 2)
+	{
+		vm = _mm_min_pd(vm, _mm_loadu_pd(&v[i]));
+	}
+
+	double lanes[2];
+	_mm_storeu_pd(lanes, vm);
+	m = min(lanes[0], lanes[1]);
+#endif
+
+	for (; i < n; i++)
+	{
+		m = min(m, v[i]);
+	}
+
+	return m;
+}
+
+static double max_doubles(const double * v, size_t n, double m)
+{
+	size_t i = 0;
+
+#if defined(__AVX2__)
+	__m256d vm = _mm256_set1_pd(m);
+	for (; i + 4 <= n; i += 4)
+	{
+		vm = _mm256_max_pd(vm, _mm256_loadu_pd(&v[i]));
+	}
+
+	double lanes[4];
+	_mm256_storeu_pd(lanes, vm);
+	m = max(max(lanes[0], lanes[1]), max(lanes[2], lanes[3]));
+#elif defined(__SSE2__)
+	__m128d vm = _mm_set1_pd(m);
+	for (; i + 2 <= n; i += 2)
+	{
+		vm = _mm_max_pd(vm, _mm_loadu_pd(&v[i]));
+	}
+
+	double lanes[2];
+	_mm_storeu_pd(lanes, vm);
+	m = max(lanes[0], lanes[1]);
+#endif
+
+	for (; i < n; i++)
+	{
+		m = max(m, v[i]);
+	}
+
+	return m;
+}
+
+static double dot_doubles(const double * a, const double * b, size_t n)
+{
+	size_t i = 0;
+	double dot = 0.0;
+
+#if defined(__AVX2__)
+	__m256d a0 = _mm256_setzero_pd(), a1 = _mm256_setzero_pd();
+	for (; i + 8 <= n; i += 8)
+	{
+		a0 = _mm256_add_pd(a0, _mm256_mul_pd(_mm256_loadu_pd(&a[i]), _mm256_loadu_pd(&b[i])));
+		a1 = _mm256_add_pd(a1, _mm256_mul_pd(_mm256_loadu_pd(&a[i + 4]), _mm256_loadu_pd(&b[i + 4])));
+	}
+
+	double lanes[4];
+	_mm256_storeu_pd(lanes, _mm256_add_pd(a0, a1));
+	dot = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+#elif defined(__SSE2__)
+	__m128d a0 = _mm_setzero_pd(), a1 = _mm_setzero_pd();
+	for (; i + 4 <= n; i += 4)
+	{
+		a0 = _mm_add_pd(a0, _mm_mul_pd(_mm_loadu_pd(&a[i]), _mm_loadu_pd(&b[i])));
+		a1 = _mm_add_pd(a1, _mm_mul_pd(_mm_loadu_pd(&a[i + 2]), _mm_loadu_pd(&b[i + 2])));
+	}
+
+	double lanes[2];
+	_mm_storeu_pd(lanes, _mm_add_pd(a0, a1));
+	dot = lanes[0] + lanes[1];
+#endif
+
+	for (; i < n; i++)
+	{
+		dot += a[i] * b[i];
+	}
+
+	return dot;
+}
+
+static void axpy_doubles(double * y, double a, const double * x, size_t n)
+{
+	size_t i = 0;
+
+#if defined(__AVX2__)
+	__m256d va = _mm256_set1_pd(a);
+	for (; i + 4 <= n; i += 4)
+	{
+		_mm256_storeu_pd(&y[i], _mm256_add_pd(_mm256_loadu_pd(&y[i]), _mm256_mul_pd(va, _mm256_loadu_pd(&x[i]))));
+	}
+#elif defined(__SSE2__)
+	__m128d va = _mm_set1_pd(a);
+	for (; i + 2 <= n; i += 2)
+	{
+		_mm_storeu_pd(&y[i], _mm_add_pd(_mm_loadu_pd(&y[i]), _mm_mul_pd(va, _mm_loadu_pd(&x[i]))));
+	}
+#endif
+
+	for (; i < n; i++)
+	{
+		y[i] += a * x[i];
+	}
+}
+
+static void clamp_doubles(double * v, double lo, double hi, size_t n)
+{
+	size_t i = 0;
+
+#if defined(__AVX2__)
+	__m256d vlo = _mm256_set1_pd(lo), vhi = _mm256_set1_pd(hi);
+	for (; i + 4 <= n; i += 4)
+	{
+		_mm256_storeu_pd(&v[i], _mm256_max_pd(vlo, _mm256_min_pd(vhi, _mm256_loadu_pd(&v[i]))));
+	}
+#elif defined(__SSE2__)
+	__m128d vlo = _mm_set1_pd(lo), vhi = _mm_set1_pd(hi);
+	for (; i + 2 <= n; i += 2)
+	{
+		_mm_storeu_pd(&v[i], _mm_max_pd(vlo, _mm_min_pd(vhi, _mm_loadu_pd(&v[i]))));
+	}
+#endif
+
+	for (; i < n; i++)
+	{
+		v[i] = max(lo, min(hi, v[i]));
+	}
+}
+
+static void convert_i2d(void * to, const void * from, size_t n)
+{
+	double * d = to;
+	const int * v = from;
+	size_t i = 0;
+
+#if defined(__AVX2__)
+	for (; i + 4 <= n; i += 4)
+	{
+		_mm256_storeu_pd(&d[i], _mm256_cvtepi32_pd(_mm_loadu_si128((const __m128i *)&v[i])));
+	}
+#elif defined(__SSE2__)
+	for (; i + 4 <= n; i += 4)
+	{
+		__m128i x = _mm_loadu_si128((const __m128i *)&v[i]);
+		_mm_storeu_pd(&d[i], _mm_cvtepi32_pd(x));
+		_mm_storeu_pd(&d[i + 2], _mm_cvtepi32_pd(_mm_srli_si128(x, 8)));
+	}
+#endif
+
+	for (; i < n; i++)
+	{
+		d[i] = v[i];
+	}
+}
+
+static void convert_d2i(void * to, const void * from, size_t n)
+{
+	int * d = to;
+	const double * v = from;
+	size_t i = 0;
+
+	// Conversion truncates towards zero, same as a C cast
+#if defined(__AVX2__)
+	for (; i + 4 <= n; i += 4)
+	{
+		_mm_storeu_si128((__m128i *)&d[i], _mm256_cvttpd_epi32(_mm256_loadu_pd(&v[i])));
+	}
+#elif defined(__SSE2__)
+	for (; i + 4 <= n; i += 4)
+	{
+		__m128i lo = _mm_cvttpd_epi32(_mm_loadu_pd(&v[i]));
+		__m128i hi = _mm_cvttpd_epi32(_mm_loadu_pd(&v[i + 2]));
+		_mm_storeu_si128((__m128i *)&d[i], _mm_unpacklo_epi64(lo, hi));
+	}
+#endif
+
+	for (; i < n; i++)
+	{
+		d[i] = (int)v[i];
+	}
+}
+
+static void convert_b2i(void * to, const void * from, size_t n)
+{
+	int * d = to;
+	const uint8_t * v = from;
+	size_t i = 0;
+
+#if defined(__SSE2__)
+	// Normalize to 0/1 and widen 16 bytes at a time
+	const __m128i zero = _mm_setzero_si128(), one = _mm_set1_epi8(1);
+	for (; i + 16 <= n; i += 16)
+	{
+		__m128i x = _mm_andnot_si128(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)&v[i]), zero), one);
+		__m128i lo = _mm_unpacklo_epi8(x, zero), hi = _mm_unpackhi_epi8(x, zero);
+		_mm_storeu_si128((__m128i *)&d[i], _mm_unpacklo_epi16(lo, zero));
+		_mm_storeu_si128((__m128i *)&d[i + 4], _mm_unpackhi_epi16(lo, zero));
+		_mm_storeu_si128((__m128i *)&d[i + 8], _mm_unpacklo_epi16(hi, zero));
+		_mm_storeu_si128((__m128i *)&d[i + 12], _mm_unpackhi_epi16(hi, zero));
+	}
+#endif
+
+	for (; i < n; i++)
+	{
+		d[i] = (v[i] != 0)? 1 : 0;
+	}
+}
+
+static void convert_i2b(void * to, const void * from, size_t n)
+{
+	uint8_t * d = to;
+	const int * v = from;
+	size_t i = 0;
+
+#if defined(__SSE2__)
+	// Compare 16 ints against zero and narrow the masks down to bytes
+	const __m128i zero = _mm_setzero_si128(), one = _mm_set1_epi8(1);
+	for (; i + 16 <= n; i += 16)
+	{
+		__m128i a = _mm_cmpeq_epi32(_mm_loadu_si128((const __m128i *)&v[i]), zero);
+		__m128i b = _mm_cmpeq_epi32(_mm_loadu_si128((const __m128i *)&v[i + 4]), zero);
+		__m128i c = _mm_cmpeq_epi32(_mm_loadu_si128((const __m128i *)&v[i + 8]), zero);
+		__m128i e = _mm_cmpeq_epi32(_mm_loadu_si128((const __m128i *)&v[i + 12]), zero);
+		__m128i x = _mm_packs_epi16(_mm_packs_epi32(a, b), _mm_packs_epi32(c, e));
+		_mm_storeu_si128((__m128i *)&d[i], _mm_andnot_si128(x, one));
+	}
+#endif
+
+	for (; i < n; i++)
+	{
+		d[i] = (v[i] != 0)? 1 : 0;
+	}
+}
+
+static void convert_b2d(void * to, const void * from, size_t n)
+{
+	double * d = to;
+	const uint8_t * v = from;
+
+	for (size_t i = 0; i < n; i++)
+	{
+		d[i] = (v[i] != 0)? 1.0 : 0.0;
+	}
+}
+
+static void convert_d2b(void * to, const void * from, size_t n)
+{
+	uint8_t * d = to;
+	const double * v = from;
+
+	for (size_t i = 0; i < n; i++)
+	{
+		d[i] = (v[i] != 0.0)? 1 : 0;
+	}
+}
+
+static convert_f convertfunc(char fromtype, char totype)
+{
+	switch (fromtype)
+	{
+		case T_ARRAY_BOOLEAN:
+		{
+			switch (totype)
+			{
+				case T_ARRAY_INTEGER:	return convert_b2i;
+				case T_ARRAY_DOUBLE:	return convert_b2d;
+				default:				return NULL;
+			}
+		}
+
+		case T_ARRAY_INTEGER:
+		{
+			switch (totype)
+			{
+				case T_ARRAY_BOOLEAN:	return convert_i2b;
+				case T_ARRAY_DOUBLE:	return convert_i2d;
+				default:				return NULL;
+			}
+		}
+
+		case T_ARRAY_DOUBLE:
+		{
+			switch (totype)
+			{
+				case T_ARRAY_BOOLEAN:	return convert_d2b;
+				case T_ARRAY_INTEGER:	return convert_d2i;
+				default:				return NULL;
+			}
+		}
+
+		default:
+		{
+			return NULL;
+		}
+	}
+}
+
+static double reduce(const array_t * array, double initial, double (*reducer)(const double * v, size_t n, double value))
+{
+	size_t end = array_size(array, T_ARRAY_DOUBLE) * sizeof(double);
+	double value = initial;
+	scratch_t scratch;
+
+	for (size_t offset = 0, count = 0; offset < end; offset += count * sizeof(double))
+	{
+		const double * span = readspan(array, offset, end, sizeof(double), &scratch, &count);
+		value = reducer(span, count, value);
+	}
+
+	return value;
+}
+
+double array_sum(const array_t * array)
+{
+	// Sanity check
+	{
+		if unlikely(array == NULL)
+		{
+			return 0.0;
+		}
+	}
+
+	return reduce(array, 0.0, sum_doubles);
+}
+
+double array_min(const array_t * array)
+{
+	// Sanity check
+	{
+		if unlikely(array == NULL || array_size(array, T_ARRAY_DOUBLE) == 0)
+		{
+			return NAN;
+		}
+	}
+
+	return reduce(array, INFINITY, min_doubles);
+}
+
+double array_max(const array_t * array)
+{
+	// Sanity check
+	{
+		if unlikely(array == NULL || array_size(array, T_ARRAY_DOUBLE) == 0)
+		{
+			return NAN;
+		}
+	}
+
+	return reduce(array, -INFINITY, max_doubles);
+}
+
+double array_mean(const array_t * array)
+{
+	// Sanity check
+	{
+		if unlikely(array == NULL || array_size(array, T_ARRAY_DOUBLE) == 0)
+		{
+			return NAN;
+		}
+	}
+
+	return array_sum(array) / array_size(array, T_ARRAY_DOUBLE);
+}
+
+double array_dot(const array_t * a, const array_t * b)
+{
+	// Sanity check
+	{
+		if unlikely(a == NULL || b == NULL)
+		{
+			return 0.0;
+		}
+	}
+
+	size_t end = min(array_size(a, T_ARRAY_DOUBLE), array_size(b, T_ARRAY_DOUBLE)) * sizeof(double);
+	double dot = 0.0;
+	scratch_t ascratch, bscratch;
+
+	for (size_t offset = 0, count = 0; offset < end; offset += count * sizeof(double))
+	{
+		size_t acount = 0, bcount = 0;
+		const double * aspan = readspan(a, offset, end, sizeof(double), &ascratch, &acount);
+		const double * bspan = readspan(b, offset, end, sizeof(double), &bscratch, &bcount);
+
+		count = min(acount, bcount);
+		dot += dot_doubles(aspan, bspan, count);
+	}
+
+	return dot;
+}
+
+bool array_axpy(array_t * y, double a, const array_t * x)
+{
+	// Sanity check
+	{
+		if unlikely(y == NULL || x == NULL)
+		{
+			return false;
+		}
+	}
+
+	size_t end = min(array_size(y, T_ARRAY_DOUBLE), array_size(x, T_ARRAY_DOUBLE)) * sizeof(double);
+	scratch_t xscratch, yscratch;
+
+	for (size_t offset = 0, count = 0; offset < end; offset += count * sizeof(double))
+	{
+		size_t xcount = 0, ycount = 0;
+		const double * xspan = readspan(x, offset, end, sizeof(double), &xscratch, &xcount);
+		double * yspan = writespan(y, offset, end, sizeof(double), &yscratch, &ycount);
+
+		count = min(xcount, ycount);
+		axpy_doubles(yspan, a, xspan, count);
+
+		if unlikely(!writedone(y, offset, yspan, count, sizeof(double), &yscratch))
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+bool array_clamp(array_t * array, double low, double high)
+{
+	// Sanity check
+	{
+		if unlikely(array == NULL || low > high)
+		{
+			return false;
+		}
+	}
+
+	size_t end = array_size(array, T_ARRAY_DOUBLE) * sizeof(double);
+	scratch_t scratch;
+
+	for (size_t offset = 0, count = 0; offset < end; offset += count * sizeof(double))
+	{
+		double * span = writespan(array, offset, end, sizeof(double), &scratch, &count);
+		clamp_doubles(span, low, high, count);
+
+		if unlikely(!writedone(array, offset, span, count, sizeof(double), &scratch))
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+bool array_convertinto(array_t * to, char totype, const array_t * from, char fromtype)
+{
+	// Sanity check
+	{
+		if unlikely(to == NULL || from == NULL)
+		{
+			return false;
+		}
+	}
+
+	convert_f convert = convertfunc(fromtype, totype);
+	if unlikely(convert == NULL)
+	{
+		return false;
+	}
+
+	size_t fromsize = array_typesize(fromtype), tosize = array_typesize(totype);
+	size_t elems = array_size(from, fromtype);
+
+	scratch_t fromscratch, toscratch;
+	for (size_t index = 0, count = 0; index < elems; index += count)
+	{
+		size_t fromcount = 0, tocount = 0;
+		const void * fromspan = readspan(from, index * fromsize, elems * fromsize, fromsize, &fromscratch, &fromcount);
+		void * tospan = writespan(to, index * tosize, elems * tosize, tosize, &toscratch, &tocount);
+
+		count = min(fromcount, tocount);
+		convert(tospan, fromspan, count);
+
+		if unlikely(!writedone(to, index * tosize, tospan, count, tosize, &toscratch))
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+array_t * array_convert(const array_t * from, char fromtype, char totype)
+{
+	// Sanity check
+	{
+		if unlikely(from == NULL || array_typesize(fromtype) == 0 || array_typesize(totype) == 0)
+		{
+			return NULL;
+		}
+	}
+
+	if (fromtype == totype)
+	{
+		return array_dup(from);
+	}
+
+	array_t * to = array_new();
+	if unlikely(to == NULL)
+	{
+		return NULL;
+	}
+
+	if (!array_convertinto(to, totype, from, fromtype))
+	{
+		array_free(to);
+		return NULL;
+	}
+
+	return to;
+}
@@ -105,6 +105,18 @@ static inline bool array_writeindex(array_t * array, char type, off_t index, con
 	return array_write(array, type, index, elem, 1) == 1;
 }
 
+// Numeric kernels, vectorized (SSE2/AVX2) over the pages of the buffer. The reductions, dot, axpy and clamp work
+// on double arrays. Min, max and mean of an empty array are NAN
+double array_sum(const array_t * array);
+double array_min(const array_t * array);
+double array_max(const array_t * array);
+double array_mean(const array_t * array);
+double array_dot(const array_t * a, const array_t * b);
+bool array_axpy(array_t * y, double a, const array_t * x);				// y += a * x (over the shorter of the two)
+bool array_clamp(array_t * array, double low, double high);
+array_t * array_convert(const array_t * from, char fromtype, char totype);	// Returns a new array, doubles truncate like a C cast
+bool array_convertinto(array_t * to, char totype, const array_t * from, char fromtype);	// Writes the converted elements at the start of to
+
 #ifdef __cplusplus
 }
 #endif
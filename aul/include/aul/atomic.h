@@ -8,4 +8,18 @@
 #define atomic_inc(variable)				atomic_add((variable), 1)
 #define atomic_dec(variable)				atomic_sub((variable), 1)
 
+#define atomic_cas(variable, old, new)		(__sync_bool_compare_and_swap(&(variable), (old), (new)))
+#define atomic_xchg(variable, value)		(__atomic_exchange_n(&(variable), (value), __ATOMIC_ACQ_REL))
+#define atomic_get(variable)				(__atomic_load_n(&(variable), __ATOMIC_ACQUIRE))
+#define atomic_set(variable, value)			(__atomic_store_n(&(variable), (value), __ATOMIC_RELEASE))
+
+#define atomic_rmb()						(__atomic_thread_fence(__ATOMIC_ACQUIRE))
+#define atomic_wmb()						(__atomic_thread_fence(__ATOMIC_RELEASE))
+
+#if defined(__i386__) || defined(__x86_64__)
+#define atomic_relax()						(__builtin_ia32_pause())
+#else
+#define atomic_relax()						(__atomic_signal_fence(__ATOMIC_SEQ_CST))
+#endif
+
 #endif
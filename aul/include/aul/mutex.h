@@ -59,6 +59,11 @@ static inline cond_t * cond_new()
 	return cond;
 }
 
+static inline bool cond_destroy(cond_t * cond)
+{
+	return pthread_cond_destroy(cond) == 0;
+}
+
 static inline bool cond_wait(cond_t * cond, mutex_t * mutex, uint64_t nanoseconds)
 {
 	if (nanoseconds == 0LL)
@@ -1,470 +1,1683 @@
 #include <stdio.h>
 #include <unistd.h>
+#include <limits.h>
 #include <errno.h>
+#include <pthread.h>
 #include <sys/uio.h>
+#include <sys/mman.h>
 
-#include <aul/mutex.h>
 #include <aul/atomic.h>
-#include <aul/stack.h>
+#include <aul/list.h>
+#include <aul/log.h>
+#include <aul/mutex.h>
 
 #include <buffer.h>
 
 
 #define TYPE_BUFFER 		0xB1
 #define TYPE_PAGE			0xB2
+#define TYPE_TABLE			0xB3
+#define TYPE_LARGE			0xB5
 
-#define PAGES_PER_BUFFER	((BUFFER_PAGESIZE - sizeof(buffer_t)) / sizeof(buffer_t *))
-#define BYTES_PER_PAGE		(BUFFER_PAGESIZE - sizeof(page_t))
-#define BYTES_PER_BUFFER	(BYTES_PER_PAGE * PAGES_PER_BUFFER)
+#define TABLES_PER_BUFFER	256			// Number of segment tables indexed from the buffer header
+#define PAGES_PER_BUFFER	((BUFFER_PAGESIZE - sizeof(buffer_t)) / sizeof(page_t *))
+#define PAGES_PER_TABLE		(BUFFER_PAGESIZE / sizeof(page_t *))
+#define MAXPAGES_PER_BUFFER	(PAGES_PER_BUFFER + TABLES_PER_BUFFER * PAGES_PER_TABLE)
+#define BYTES_PER_PAGE		((size_t)BUFFER_PAGESIZE)
+#define BYTES_PER_BUFFER	(BYTES_PER_PAGE * MAXPAGES_PER_BUFFER)
 
 #define BYTES_PER_SMALLPAGE	(BYTES_PER_PAGE - sizeof(uint16_t))
 #define smallpage_size(p)	((uint16_t *)&(p)->data[BYTES_PER_SMALLPAGE])
 
+#define isinline(b)			((uintptr_t)(b) - (uintptr_t)memory >= reserved)	// Inline buffers live outside the pool range
+
+#define extent_data(e)		((uint8_t *)(e) + BUFFER_PAGESIZE)		// Extent payload starts one page in, keeping it page aligned
+#define LARGE_THRESHOLD		(4 * 1024 * 1024)	// Buffers growing past this move to an extent (a send of them no longer fits IOV_MAX pages)
+
+#define MAGAZINE_SIZE		64			// Number of pages moved between a thread cache and the depot at once
+#define CACHE_SIZE			(MAGAZINE_SIZE * 2)
+#define MAX_RECLAIMERS		8
+#define DEPOT_TAGBITS		32			// Depot heads are [ page number + 1 | ABA tag ], the tag wraps after 2^32 pops
+#define DEPOT_TAGMASK		((UINT64_C(1) << DEPOT_TAGBITS) - 1)
+
 
 typedef struct
 {
+	// Page metadata lives in a side table indexed by page number (see pagemeta),
+	// so every payload page is a full, page-aligned BUFFER_PAGESIZE bytes
 	uint8_t type;
 	uint16_t refs;
-	uint8_t data[0];
+} meta_t;
+
+typedef struct
+{
+	uint8_t data[BYTES_PER_PAGE];
 } page_t;
 
+typedef struct
+{
+	// A segment table is a (refcounted) pool page holding the next PAGES_PER_TABLE page pointers of a buffer
+	page_t * pages[PAGES_PER_TABLE];
+} table_t;
+
 struct __buffer_t
 {
-	uint8_t type;
+	// The first PAGES_PER_BUFFER pages are indexed directly from the header, the rest through the
+	// segment tables. Any byte offset maps to its page in O(1) and the total size is cached here
+	// A slice starts base bytes into its first page
+	uint16_t base;
 	size_t size;
-	buffer_t * next;
+	table_t * tables[TABLES_PER_BUFFER];
 	page_t * pages[0];
 };
 
+typedef struct
+{
+	// A contiguous mmap'd extent backing a large buffer, shared (refcounted) between dups and slices
+	volatile size_t refs;
+	size_t capacity;
+} extent_t;
+
+typedef struct
+{
+	// Header of a large buffer (lives in a pool page), the data is base bytes into the extent
+	size_t base;
+	size_t size;
+	extent_t * extent;
+} large_t;
+
+typedef struct
+{
+	// An inline buffer lives in caller owned storage outside the pool (see buffer_newinline)
+	size_t size;
+	uint8_t data[BUFFER_INLINECAPACITY];
+} inline_t;
+
+typedef struct __magazine_t magazine_t;
+struct __magazine_t
+{
+	// A magazine lives inside the first free page of a batch and lists the rest of the batch
+	magazine_t * next;
+	size_t count;
+	void * pages[MAGAZINE_SIZE - 1];
+};
+
+typedef struct
+{
+	bool registered;
+	bool realtime;					// Thread may dip into the emergency reserve
+	size_t count;
+	void * pages[CACHE_SIZE];
+	list_t cache_list;
+} cache_t;
+
+
+static void * memory = NULL;				// Start of the reserved pool address range
+static meta_t * metadata = NULL;			// Metadata of every page in the reserved range
+static size_t reserved = 0;					// Size of the reserved address range
+static size_t mapped = 0;					// Bytes of the reserved range backed by arenas
+static int poolflags = 0;
+static bool hugepages = false;				// Still asking for MAP_HUGETLB arenas
+static bool * hugearenas = NULL;			// Per arena, backed by MAP_HUGETLB pages
+static mutex_t growlock;
+
+static volatile uint64_t depot = 0;			// Lock-free stack of resident magazines
+static volatile uint64_t released = 0;		// Lock-free stack of magazines whose memory was given back to the OS
+static volatile uint64_t emergency = 0;		// Lock-free stack of magazines held back for realtime threads
+static pthread_key_t cachekey;
+static list_t caches;
+static mutex_t cachelock;
+
+static size_t lowwater = 0, highwater = 0;	// In pages
+static volatile size_t pages_free = 0, pages_released = 0, pages_highwater = 0, alloc_failures = 0;
+static volatile size_t large_extents = 0, large_bytes = 0;
+
+static uint64_t waitnanos = 0;				// How long non-realtime threads wait for pages when the pool is exhausted
+static size_t reservepages = 0;				// Size of the emergency reserve
+static mutex_t waitlock;
+static cond_t waitcond;
+static volatile size_t waiters = 0;
+static volatile size_t pages_reserved = 0, waits = 0, wait_timeouts = 0, reserve_allocs = 0, reclaimed = 0;
+static volatile size_t inline_overflows = 0;
+
+static struct
+{
+	bufferreclaim_f reclaim;
+	void * userdata;
+} reclaimers[MAX_RECLAIMERS];
+static volatile size_t numreclaimers = 0;
 
-static void * memory = NULL;
-static stack_t freepages;
-static mutex_t freelock;
+static threadlocal cache_t cache = { false, false, 0, {0}, {0} };
 
 static const page_t * zero = NULL;
 
+static inline meta_t * pagemeta(const void * page)
+{
+	return &metadata[((uintptr_t)page - (uintptr_t)memory) / BUFFER_PAGESIZE];
+}
+
 static inline void initpage(page_t * page)
 {
-	page->type = TYPE_PAGE;
-	page->refs = 1;
+	pagemeta(page)->type = TYPE_PAGE;
+	pagemeta(page)->refs = 1;
 	memset(page->data, 0, BYTES_PER_PAGE);
 }
 
 static inline void branchpage(const page_t * page, page_t * new)
 {
-	new->type = TYPE_PAGE;
-	new->refs = 1;
+	pagemeta(new)->type = TYPE_PAGE;
+	pagemeta(new)->refs = 1;
 	memcpy(new->data, page->data, BYTES_PER_PAGE);
 }
 
 static inline void initbuffer(buffer_t * buffer)
 {
-	buffer->type = TYPE_BUFFER;
+	pagemeta(buffer)->type = TYPE_BUFFER;
+	pagemeta(buffer)->refs = 1;
+	buffer->base = 0;
 	buffer->size = 0;
-	buffer->next = NULL;
+	memset(buffer->tables, 0, sizeof(table_t *) * TABLES_PER_BUFFER);
 	memset(buffer->pages, 0, sizeof(page_t *) * PAGES_PER_BUFFER);
 }
 
-static inline void * getfree()
+static inline void inittable(table_t * table)
+{
+	pagemeta(table)->type = TYPE_TABLE;
+	pagemeta(table)->refs = 1;
+	memset(table->pages, 0, sizeof(page_t *) * PAGES_PER_TABLE);
+}
+
+static inline void branchtable(const table_t * table, table_t * new)
 {
-	void * page = NULL;
-	mutex_lock(&freelock);
+	pagemeta(new)->type = TYPE_TABLE;
+	pagemeta(new)->refs = 1;
+
+	for (size_t index = 0; index < PAGES_PER_TABLE; index++)
 	{
-		page = stack_pop(&freepages);
+		page_t * page = table->pages[index];
+		if (page != NULL)
+		{
+			atomic_inc(pagemeta(page)->refs);
+		}
+
+		new->pages[index] = page;
 	}
-	mutex_unlock(&freelock);
+}
 
-	return page;
+static inline magazine_t * depot_magazine(uint64_t head)
+{
+	// A depot head refers to its magazine by page number (0 is the empty stack), leaving half the word for the tag
+	uint64_t index = head >> DEPOT_TAGBITS;
+	return (index == 0)? NULL : (magazine_t *)((uint8_t *)memory + (index - 1) * BUFFER_PAGESIZE);
 }
 
-static inline void putfree(void * page)
+static inline uint64_t depot_head(const magazine_t * magazine, uint64_t head)
 {
-	mutex_lock(&freelock);
+	// Bump the tag of the previous head on every push and pop
+	uint64_t index = (magazine == NULL)? 0 : ((uintptr_t)magazine - (uintptr_t)memory) / BUFFER_PAGESIZE + 1;
+	return (index << DEPOT_TAGBITS) | ((head + 1) & DEPOT_TAGMASK);
+}
+
+static void depot_push(volatile uint64_t * stack, magazine_t * magazine)
+{
+	uint64_t head = 0, newhead = 0;
+	do
+	{
+		head = *stack;
+		magazine->next = depot_magazine(head);
+		newhead = depot_head(magazine, head);
+	} while (!atomic_cas(*stack, head, newhead));
+
+	atomic_add(pages_free, magazine->count + 1);
+
+	if (unlikely(waiters > 0) && stack != &emergency)
 	{
-		stack_push(&freepages, page);
+		// Somebody is waiting for pages (freed, grown or released to the OS, they can take any of them)
+		mutex_lock(&waitlock);
+		{
+			cond_broadcast(&waitcond);
+		}
+		mutex_unlock(&waitlock);
 	}
-	mutex_unlock(&freelock);
 }
 
-static inline buffer_t * promote(page_t * page)
+static magazine_t * depot_pop(volatile uint64_t * stack)
 {
-	page_t * new = NULL;
-	uint16_t size = *smallpage_size(page);
-
-	if (size > 0)
+	uint64_t head = 0, newhead = 0;
+	magazine_t * magazine = NULL;
+	do
 	{
-		new = getfree();
-		if unlikely(new == NULL)
+		head = *stack;
+		magazine = depot_magazine(head);
+		if (magazine == NULL)
 		{
 			return NULL;
 		}
 
-		branchpage(page, new);
-		*smallpage_size(new) = 0;		// Clear out the size info of the new page
-	}
+		// The magazine may be popped (and reused) by another thread before we get to the cas,
+		// in that case the tag has changed and we try again. Pool memory is never unmapped so the read is safe
+		newhead = depot_head(magazine->next, head);
+	} while (!atomic_cas(*stack, head, newhead));
 
-	buffer_t * buffer = (buffer_t *)page;
-	initbuffer(buffer);
-	buffer->size = size;
-	buffer->pages[0] = new;
+	size_t free = atomic_sub(pages_free, magazine->count + 1);
+	size_t checkedout = (mapped / BUFFER_PAGESIZE) - free;
+	if (checkedout > pages_highwater)
+	{
+		// Racy, but only ever used for statistics
+		pages_highwater = checkedout;
+	}
 
-	return buffer;
+	return magazine;
 }
 
-bool buffer_init(size_t poolsize, exception_t ** err)
+static void depot_fill(void * start, size_t pages)
 {
-	// Sanity check
+	// Add pages to the depot, one magazine at a time
+	for (size_t i = 0; i < pages; i += MAGAZINE_SIZE)
 	{
-		if unlikely(exception_check(err))
+		magazine_t * magazine = start + (BUFFER_PAGESIZE * i);
+		magazine->count = min(pages - i, (size_t)MAGAZINE_SIZE) - 1;
+
+		for (size_t j = 0; j < magazine->count; j++)
 		{
-			return false;
+			magazine->pages[j] = start + (BUFFER_PAGESIZE * (i + j + 1));
 		}
+
+		depot_push(&depot, magazine);
 	}
+}
 
-	stack_init(&freepages);
-	mutex_init(&freelock, M_RECURSIVE);
+static bool pool_grow(size_t arenas)
+{
+	bool success = false;
 
-	size_t pages = poolsize / BUFFER_PAGESIZE;
-	int e = posix_memalign(&memory, BUFFER_PAGESIZE, BUFFER_PAGESIZE * pages);		// Allocate aligned memory
-	if (e != 0 || memory == NULL)
+	mutex_lock(&growlock);
 	{
-		exception_set(err, ENOMEM, "Could not allocte buffer space, currently set to %zu bytes: %s", poolsize, strerror(errno));
-		memory = NULL;
-		return false;
-	}
+		size_t length = min(arenas * BUFFER_ARENASIZE, reserved - mapped);
+		if (length == 0)
+		{
+			goto done;
+		}
 
-	// Add pages to free list
-	for (size_t i = 0; i < pages; i++)
-	{
-		list_t * list = (list_t *)(memory + (BUFFER_PAGESIZE * i));
-		stack_push(&freepages, list);
-	}
+		void * start = memory + mapped;
+		void * arena = MAP_FAILED;
 
-	// Create zero page
-	{
-		page_t * zeropage = getfree();
-		if unlikely(zeropage == NULL)
+		bool huge = false;
+		if (hugepages)
 		{
-			exception_set(err, EFAULT, "Could not allocate zero page!");
-			return false;
+			arena = mmap(start, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED | MAP_HUGETLB, -1, 0);
+			huge = (arena != MAP_FAILED);
+
+			if (!huge)
+			{
+				// Out of reserved huge pages (or none in the system), this and later arenas get transparent huge pages
+				log_write(LEVEL_WARNING, "BUFFER", "Could not back buffer arena %zu with huge pages, falling back to normal pages: %s", mapped / BUFFER_ARENASIZE, strerror(errno));
+				hugepages = false;
+			}
 		}
 
-		initpage(zeropage);
-		zero = zeropage;
+		if (arena == MAP_FAILED)
+		{
+			arena = mmap(start, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0);
+			if (arena == MAP_FAILED)
+			{
+				goto done;
+			}
+
+			if (poolflags & BUFFER_HUGEPAGES)
+			{
+				madvise(arena, length, MADV_HUGEPAGE);
+			}
+		}
+
+		for (size_t i = 0; i < length / BUFFER_ARENASIZE; i++)
+		{
+			hugearenas[mapped / BUFFER_ARENASIZE + i] = huge;
+		}
+
+		mapped += length;
+		depot_fill(arena, length / BUFFER_PAGESIZE);
+		success = true;
 	}
+done:
+	mutex_unlock(&growlock);
 
-	return true;
+	return success;
 }
 
-void buffer_destroy()
+static void cache_drain(cache_t * c, size_t count)
 {
-	mutex_lock(&freelock);
+	// Pack the top count pages of the cache into a magazine and hand it back to the depot
+	c->count -= count;
+
+	magazine_t * magazine = c->pages[c->count];
+	magazine->count = count - 1;
+	memcpy(magazine->pages, &c->pages[c->count + 1], sizeof(void *) * (count - 1));
+
+	depot_push(&depot, magazine);
+}
+
+static void cache_destroy(void * object)
+{
+	// Called on thread exit, return all cached pages to the depot
+	cache_t * c = object;
+	while (c->count > 0)
 	{
-		// Empty the freepages stack
-		while (stack_pop(&freepages) != NULL) {}
+		cache_drain(c, min(c->count, (size_t)MAGAZINE_SIZE));
 	}
-	mutex_unlock(&freelock);
 
-	if (memory != NULL)
+	mutex_lock(&cachelock);
 	{
-		free(memory);
+		list_remove(&c->cache_list);
+		c->registered = false;
 	}
-
-	mutex_destroy(&freelock);
+	mutex_unlock(&cachelock);
 }
 
-buffer_t * buffer_new()
+static magazine_t * pool_reuse()
 {
-	page_t * page = getfree();
-	if unlikely(page == NULL)
+	magazine_t * magazine = depot_pop(&depot);
+	if (magazine == NULL)
 	{
-		return NULL;
+		// Out of resident pages, try the ones given back to the OS (they will fault back in on use)
+		magazine = depot_pop(&released);
+		if (magazine != NULL)
+		{
+			atomic_sub(pages_released, magazine->count);
+		}
 	}
 
-	initpage(page);
-	return (buffer_t *)page;
+	return magazine;
 }
 
-buffer_t * buffer_dup(const buffer_t * src)
+static magazine_t * pool_take()
 {
-	// Sanity check
+	magazine_t * magazine = pool_reuse();
+	if (magazine == NULL)
 	{
-		if unlikely(src == NULL)
+		// Pool is empty, grow it by an arena and try again
+		if (pool_grow(1))
 		{
-			return NULL;
+			magazine = depot_pop(&depot);
 		}
 	}
 
-	if (src->type == TYPE_PAGE)
-	{
-		// Src really points to a page, branch the page
+	return magazine;
+}
 
-		page_t * page = getfree();
-		if unlikely(page == NULL)
+static magazine_t * pool_exhausted(cache_t * c)
+{
+	// The pool is at its maximum size and empty. First ask the reclaimers (eg. queued service packets)
+	// to give memory back
+	for (size_t i = 0; i < numreclaimers; i++)
+	{
+		size_t freed = reclaimers[i].reclaim(reclaimers[i].userdata);
+		if (freed > 0)
 		{
-			return NULL;
-		}
+			atomic_add(reclaimed, freed);
 
-		branchpage((const page_t *)src, page);
-		return (buffer_t *)page;
+			magazine_t * magazine = depot_pop(&depot);
+			if (magazine != NULL || c->count > 0)
+			{
+				return magazine;
+			}
+		}
 	}
-	else if (src->type == TYPE_BUFFER)
-	{
-		// Src points to a buffer, do a shallow copy
 
-		buffer_t * buffer = getfree();
-		if unlikely(buffer == NULL)
+	if (c->realtime)
+	{
+		// Realtime threads can't wait, take from the emergency reserve
+		magazine_t * magazine = depot_pop(&emergency);
+		if (magazine != NULL)
 		{
-			return NULL;
+			atomic_sub(pages_reserved, magazine->count + 1);
+			atomic_inc(reserve_allocs);
 		}
 
-		initbuffer(buffer);
-		buffer->size = src->size;
+		return magazine;
+	}
 
-		for (size_t index = 0; index < PAGES_PER_BUFFER; index++)
+	if (waitnanos > 0)
+	{
+		// Wait (bounded) for another thread to return pages
+		atomic_inc(waits);
+
+		magazine_t * magazine = NULL;
+		mutex_lock(&waitlock);
 		{
-			page_t * page = src->pages[index];
-			if (page != NULL)
+			// Every path that adds free pages wakes us, keep waiting if another thread beat us to them
+			atomic_inc(waiters);
+			while ((magazine = pool_reuse()) == NULL && cond_wait(&waitcond, &waitlock, waitnanos))
 			{
-				atomic_inc(page->refs);
-				buffer->pages[index] = page;
+				// Woken, but nothing left for us
 			}
+			atomic_dec(waiters);
 		}
+		mutex_unlock(&waitlock);
 
-		if (src->next != NULL)
+		if (magazine == NULL)
 		{
-			if ((buffer->next = buffer_dup(src->next)) == NULL)
-			{
-				// Out of buffer memory!
-				buffer_free(buffer);
-				return NULL;
-			}
+			atomic_inc(wait_timeouts);
 		}
-		return buffer;
+
+		return magazine;
 	}
 
 	return NULL;
 }
 
-size_t buffer_write(buffer_t * buffer, const void * data, off_t offset, size_t length)
+static bool cache_refill(cache_t * c)
 {
-	// Sanity check
+	if unlikely(!c->registered)
 	{
-		if unlikely(buffer == NULL || data == NULL || offset < 0)
+		// First pool access from this thread, make sure the cache is returned when the thread exits
+		mutex_lock(&cachelock);
 		{
-			return 0;
+			list_add(&caches, &c->cache_list);
+			c->registered = true;
 		}
+		mutex_unlock(&cachelock);
+
+		pthread_setspecific(cachekey, c);
 	}
 
-	if (buffer->type == TYPE_PAGE)
+	magazine_t * magazine = pool_take();
+	if unlikely(magazine == NULL)
 	{
-		// We are writing to a single page
-		size_t ensuresize = offset + length;
-		page_t * page = (page_t *)buffer;
-
-		if (ensuresize > BYTES_PER_SMALLPAGE)
+		magazine = pool_exhausted(c);
+		if (c->count > 0)
 		{
-			// We need more room than this page, promote this page to a full buffer
-			// Let the next root if-statement catch it and do the writing
-			if ((buffer = promote(page)) == NULL)
-			{
-				// Could not promote buffer (probably due to not enough free buffers)
-				return 0;
-			}
+			// Reclaimers freed pages straight into this cache
+			if (magazine != NULL)	depot_push(&depot, magazine);
+			return true;
 		}
-		else
-		{
-			// We have enough room in this page to write the data
-			uint16_t * size = smallpage_size(page);
-			if (offset > *size)
-			{
-				// Make sure that the memory between page->size and offset are filled with zeros
-				memset(&page->data[*size], 0, offset - *size);
-			}
 
-			memcpy(&page->data[offset], data, length);
-			*size = max(*size, ensuresize);
-
-			return length;
+		if (magazine == NULL)
+		{
+			atomic_inc(alloc_failures);
+			return false;
 		}
 	}
 
-	if (buffer->type == TYPE_BUFFER)
+	memcpy(&c->pages[c->count], magazine->pages, sizeof(void *) * magazine->count);
+	c->count += magazine->count;
+	c->pages[c->count++] = magazine;
+
+	return true;
+}
+
+static inline void * getfree()
+{
+	if unlikely(cache.count == 0 && !cache_refill(&cache))
 	{
-		// Pass onto the next
-		if ((size_t)offset >= BYTES_PER_BUFFER)
-		{
-			// Make sure that buffer has a next
-			if (buffer->next == NULL)
-			{
-				buffer->next = buffer_new();
-			}
+		return NULL;
+	}
 
-			size_t totalwrote = buffer_write(buffer->next, data, offset - BYTES_PER_BUFFER, length);
-			if (totalwrote > 0)
-			{
-				// Only update the buffer size after successful write
-				buffer->size = BYTES_PER_BUFFER;
-			}
+	return cache.pages[--cache.count];
+}
 
-			return totalwrote;
-		}
+static inline void putfree(void * page)
+{
+	if unlikely(cache.count == CACHE_SIZE)
+	{
+		cache_drain(&cache, MAGAZINE_SIZE);
+	}
 
-		size_t totalwrote = 0;
-		size_t pagenum = offset / BYTES_PER_PAGE;
-		off_t pageoff = offset % BYTES_PER_PAGE;
-		size_t given = offset;
+	cache.pages[cache.count++] = page;
+}
 
-		while (length > 0)
+static bool pool_release(magazine_t * magazine)
+{
+	// Give the memory of the listed pages back to the OS, the magazine page itself stays resident
+	size_t index = 0;
+	while (index < magazine->count)
+	{
+		// Coalesce runs of adjacent pages into a single call
+		void * start = magazine->pages[index];
+		size_t length = BUFFER_PAGESIZE;
+		while (++index < magazine->count && magazine->pages[index] == start + length)
 		{
-			// Check for overflow
-			if (pagenum == PAGES_PER_BUFFER)
-			{
-				// Overflowed this buffer, start writing to the next one
-				if (buffer->next == NULL)
-				{
-					buffer->next = buffer_new();
-				}
+			length += BUFFER_PAGESIZE;
+		}
 
-				return totalwrote + buffer_write(buffer->next, data, 0, length);
-			}
+		munlock(start, length);
+		if (madvise(start, length, MADV_DONTNEED) != 0)
+		{
+			return false;
+		}
+	}
 
-			page_t * page = buffer->pages[pagenum];
+	return true;
+}
 
-			// Check for null page
-			if (page == NULL)
-			{
-				page_t * new = getfree();
-				if unlikely(new == NULL)
-				{
-					// Could not allocate free page!
-					return totalwrote;
-				}
-
-				initpage(new);
-				page = buffer->pages[pagenum] = new;
-			}
+static inline void droppage(page_t * page)
+{
+	if (atomic_dec(pagemeta(page)->refs) == 0)
+	{
+		putfree(page);
+	}
+}
 
-			// Check for readonly
-			if (page->refs > 1)
+static void droptable(table_t * table)
+{
+	if (atomic_dec(pagemeta(table)->refs) == 0)
+	{
+		for (size_t index = 0; index < PAGES_PER_TABLE; index++)
+		{
+			if (table->pages[index] != NULL)
 			{
-				page_t * new = getfree();
-				if unlikely(new == NULL)
-				{
-					// Could not allocate free page
-					return totalwrote;
-				}
-
-				branchpage(page, new);
-				if (atomic_dec(page->refs) == 0)
-				{
-					putfree(page);
-				}
-
-				page = buffer->pages[pagenum] = new;
+				droppage(table->pages[index]);
 			}
-
-			// Determine how many bytes to write
-			size_t writelen = min(length, BYTES_PER_PAGE - pageoff);
-
-			// Memcpy the bytes
-			memcpy(&page->data[pageoff], data, writelen);
-
-			// Update the buffer size parameter
-			given += writelen;
-			buffer->size = max(buffer->size, given);
-
-			// Update the loop tracking variables
-			length -= writelen;
-			data += writelen;
-			totalwrote += writelen;
-			pagenum += 1;
-			pageoff = 0;
 		}
 
-		return totalwrote;
+		putfree(table);
 	}
-
-	return 0;
 }
 
-size_t buffer_read(const buffer_t * buffer, void * data, off_t offset, size_t length)
+static void dropbuffer(buffer_t * buffer)
 {
-	// Sanity check
+	// Release the pages and segment tables of a (TYPE_BUFFER) buffer, but not the header itself
+	for (size_t index = 0; index < PAGES_PER_BUFFER; index++)
 	{
-		if unlikely(buffer == NULL || data == NULL || offset < 0)
+		if (buffer->pages[index] != NULL)
 		{
-			return 0;
+			droppage(buffer->pages[index]);
 		}
 	}
 
-	if (buffer->type == TYPE_PAGE)
+	for (size_t index = 0; index < TABLES_PER_BUFFER; index++)
 	{
-		const page_t * page = (const page_t *)buffer;
-		size_t size = *smallpage_size(page);
-		if ((size_t)offset >= size)
+		if (buffer->tables[index] != NULL)
+		{
+			droptable(buffer->tables[index]);
+		}
+	}
+}
+
+static inline page_t * getpage(const buffer_t * buffer, size_t pagenum)
+{
+	if (pagenum < PAGES_PER_BUFFER)
+	{
+		return buffer->pages[pagenum];
+	}
+	else if (pagenum < MAXPAGES_PER_BUFFER)
+	{
+		pagenum -= PAGES_PER_BUFFER;
+
+		const table_t * table = buffer->tables[pagenum / PAGES_PER_TABLE];
+		if (table != NULL)
+		{
+			return table->pages[pagenum % PAGES_PER_TABLE];
+		}
+	}
+
+	return NULL;
+}
+
+static inline const page_t * readpage(const buffer_t * buffer, size_t pagenum)
+{
+	// Holes read as zeros
+	const page_t * page = getpage(buffer, pagenum);
+	return (page == NULL)? zero : page;
+}
+
+static page_t ** pageslot(buffer_t * buffer, size_t pagenum)
+{
+	if (pagenum < PAGES_PER_BUFFER)
+	{
+		return &buffer->pages[pagenum];
+	}
+
+	pagenum -= PAGES_PER_BUFFER;
+
+	size_t tablenum = pagenum / PAGES_PER_TABLE;
+	if unlikely(tablenum >= TABLES_PER_BUFFER)
+	{
+		// Buffer is at maximum capacity
+		return NULL;
+	}
+
+	table_t * table = buffer->tables[tablenum];
+
+	// Check for null table
+	if (table == NULL)
+	{
+		table_t * new = getfree();
+		if unlikely(new == NULL)
+		{
+			return NULL;
+		}
+
+		inittable(new);
+		table = buffer->tables[tablenum] = new;
+	}
+
+	// Check for readonly (table shared with a dup'd buffer)
+	if (pagemeta(table)->refs > 1)
+	{
+		table_t * new = getfree();
+		if unlikely(new == NULL)
+		{
+			return NULL;
+		}
+
+		branchtable(table, new);
+		droptable(table);
+		table = buffer->tables[tablenum] = new;
+	}
+
+	return &table->pages[pagenum % PAGES_PER_TABLE];
+}
+
+static page_t * writepage(buffer_t * buffer, size_t pagenum)
+{
+	page_t ** slot = pageslot(buffer, pagenum);
+	if unlikely(slot == NULL)
+	{
+		return NULL;
+	}
+
+	page_t * page = *slot;
+
+	// Check for null page
+	if (page == NULL)
+	{
+		page_t * new = getfree();
+		if unlikely(new == NULL)
+		{
+			return NULL;
+		}
+
+		initpage(new);
+		page = *slot = new;
+	}
+
+	// Check for readonly
+	if (pagemeta(page)->refs > 1)
+	{
+		page_t * new = getfree();
+		if unlikely(new == NULL)
+		{
+			return NULL;
+		}
+
+		branchpage(page, new);
+		droppage(page);
+		page = *slot = new;
+	}
+
+	return page;
+}
+
+static bool cleartail(buffer_t * buffer, size_t offset)
+{
+	// Bytes between the end of the buffer and offset must read as zeros, but pages past the end may still
+	// hold data (from a slice source or a reserve that was never committed)
+	size_t end = buffer->base + buffer->size;
+	size_t until = buffer->base + offset;
+
+	for (size_t pagenum = end / BYTES_PER_PAGE; pagenum * BYTES_PER_PAGE < until; pagenum++)
+	{
+		if (getpage(buffer, pagenum) == NULL)
+		{
+			continue;
+		}
+
+		size_t from = max(end, pagenum * BYTES_PER_PAGE);
+		if (from % BYTES_PER_PAGE == 0)
+		{
+			// Whole page is past the end, turn it back into a hole
+			page_t ** slot = pageslot(buffer, pagenum);
+			if unlikely(slot == NULL)
+			{
+				return false;
+			}
+
+			droppage(*slot);
+			*slot = NULL;
+		}
+		else
+		{
+			page_t * page = writepage(buffer, pagenum);
+			if unlikely(page == NULL)
+			{
+				return false;
+			}
+
+			memset(&page->data[from % BYTES_PER_PAGE], 0, min(until - from, BYTES_PER_PAGE - from % BYTES_PER_PAGE));
+		}
+	}
+
+	return true;
+}
+
+static inline size_t extent_capacity(size_t capacity)
+{
+	// Round up to whole pages, or to whole arenas so the extent can be backed by (transparent) huge pages
+	size_t granule = (capacity >= BUFFER_ARENASIZE)? BUFFER_ARENASIZE : BUFFER_PAGESIZE;
+	return ((capacity + BUFFER_PAGESIZE + granule - 1) / granule) * granule - BUFFER_PAGESIZE;
+}
+
+static extent_t * extent_new(size_t capacity)
+{
+	capacity = extent_capacity(capacity);
+
+	extent_t * extent = mmap(NULL, BUFFER_PAGESIZE + capacity, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (extent == MAP_FAILED)
+	{
+		atomic_inc(alloc_failures);
+		return NULL;
+	}
+
+	if (capacity >= BUFFER_ARENASIZE && (poolflags & BUFFER_HUGEPAGES))
+	{
+		madvise(extent, BUFFER_PAGESIZE + capacity, MADV_HUGEPAGE);
+	}
+
+	extent->refs = 1;
+	extent->capacity = capacity;
+
+	atomic_inc(large_extents);
+	atomic_add(large_bytes, capacity);
+	return extent;
+}
+
+static void extent_drop(extent_t * extent)
+{
+	if (atomic_dec(extent->refs) == 0)
+	{
+		atomic_dec(large_extents);
+		atomic_sub(large_bytes, extent->capacity);
+		munmap(extent, BUFFER_PAGESIZE + extent->capacity);
+	}
+}
+
+static bool large_ensure(large_t * large, size_t length)
+{
+	// Make the extent exclusive to this buffer with room for at least length bytes
+	extent_t * extent = large->extent;
+
+	if (extent->refs > 1)
+	{
+		// Shared with a dup or slice, branch the used part into a new extent
+		extent_t * new = extent_new(max(length, large->size));
+		if unlikely(new == NULL)
+		{
+			return false;
+		}
+
+		memcpy(extent_data(new), extent_data(extent) + large->base, large->size);
+		extent_drop(extent);
+
+		large->extent = new;
+		large->base = 0;
+	}
+	else if (large->base + length > extent->capacity)
+	{
+		// Grow in place (or move) at least geometrically
+		size_t capacity = extent_capacity(max(large->base + length, extent->capacity * 2));
+
+		extent_t * moved = mremap(extent, BUFFER_PAGESIZE + extent->capacity, BUFFER_PAGESIZE + capacity, MREMAP_MAYMOVE);
+		if (moved == MAP_FAILED)
+		{
+			atomic_inc(alloc_failures);
+			return false;
+		}
+
+		atomic_add(large_bytes, capacity - moved->capacity);
+		moved->capacity = capacity;
+		large->extent = moved;
+	}
+
+	return true;
+}
+
+static bool large_fill(large_t * large, size_t offset)
+{
+	// Bytes between the end of the buffer and offset must read as zeros, the extent may still hold old data there
+	if (offset > large->size)
+	{
+		if (!large_ensure(large, offset))
+		{
+			return false;
+		}
+
+		memset(extent_data(large->extent) + large->base + large->size, 0, offset - large->size);
+	}
+
+	return true;
+}
+
+static buffer_t * enlarge(buffer_t * buffer, size_t length)
+{
+	// Move a small or paged buffer into a new extent with room for length bytes, keeping the handle
+	size_t size = 0;
+	extent_t * extent = NULL;
+
+	if (pagemeta(buffer)->type == TYPE_PAGE)
+	{
+		const page_t * page = (const page_t *)buffer;
+		size = *smallpage_size(page);
+
+		if ((extent = extent_new(max(length, size))) == NULL)
+		{
+			return NULL;
+		}
+
+		memcpy(extent_data(extent), page->data, size);
+	}
+	else
+	{
+		size = buffer->size;
+
+		if ((extent = extent_new(max(length, size))) == NULL)
+		{
+			return NULL;
+		}
+
+		// Holes are left alone, a fresh extent reads as zeros
+		for (size_t pagenum = buffer->base / BYTES_PER_PAGE; pagenum * BYTES_PER_PAGE < buffer->base + size; pagenum++)
+		{
+			const page_t * page = getpage(buffer, pagenum);
+			if (page != NULL)
+			{
+				size_t from = max(pagenum * BYTES_PER_PAGE, buffer->base);
+				size_t until = min((pagenum + 1) * BYTES_PER_PAGE, buffer->base + size);
+				memcpy(extent_data(extent) + from - buffer->base, &page->data[from % BYTES_PER_PAGE], until - from);
+			}
+		}
+
+		dropbuffer(buffer);
+	}
+
+	large_t * large = (large_t *)buffer;
+	pagemeta(large)->type = TYPE_LARGE;
+	large->base = 0;
+	large->size = size;
+	large->extent = extent;
+
+	return buffer;
+}
+
+static inline const page_t * smallpage(const buffer_t * buffer, size_t * size)
+{
+	// Small buffer, the buffer is the page
+	const page_t * page = (const page_t *)buffer;
+	*size = *smallpage_size(page);
+	return page;
+}
+
+static inline buffer_t * promote(buffer_t * buffer)
+{
+	page_t * new = NULL;
+	page_t * page = (page_t *)buffer;
+	size_t size = *smallpage_size(page);
+
+	if (size > 0)
+	{
+		new = getfree();
+		if unlikely(new == NULL)
+		{
+			return NULL;
+		}
+
+		branchpage(page, new);
+		*smallpage_size(new) = 0;		// Clear out the size info of the new page
+	}
+
+	initbuffer(buffer);
+	buffer->size = size;
+	buffer->pages[0] = new;
+
+	return buffer;
+}
+
+static void inline_overflow(size_t offset, size_t length)
+{
+	// The handle is caller storage, so the buffer can't be moved to the pool from here. Count it and say so (once),
+	// the owner has to spill it first (see iobacking_spill)
+	if (atomic_inc(inline_overflows) == 1)
+	{
+		log_write(LEVEL_WARNING, "BUFFER", "Write of %zu bytes at offset %zu doesn't fit an inline buffer (%zu bytes), it must be moved to the pool first", length, offset, (size_t)BUFFER_INLINECAPACITY);
+	}
+}
+
+static inline bool inline_fill(inline_t * in, size_t offset, size_t length)
+{
+	if unlikely(offset + length > BUFFER_INLINECAPACITY)
+	{
+		// Inline buffers can't grow past their storage
+		inline_overflow(offset, length);
+		return false;
+	}
+
+	if (offset > in->size)
+	{
+		memset(&in->data[in->size], 0, offset - in->size);
+	}
+
+	return true;
+}
+
+static buffer_t * inline_copy(const inline_t * in, size_t offset, size_t length)
+{
+	// Copy (part of) an inline buffer into a new small pool buffer, the inline storage isn't refcounted
+	page_t * page = getfree();
+	if unlikely(page == NULL)
+	{
+		return NULL;
+	}
+
+	initpage(page);
+	memcpy(page->data, &in->data[offset], length);
+	*smallpage_size(page) = length;
+
+	return (buffer_t *)page;
+}
+
+bool buffer_init(size_t initialsize, size_t maxsize, int flags, exception_t ** err)
+{
+	// Sanity check
+	{
+		if unlikely(exception_check(err))
+		{
+			return false;
+		}
+
+		if unlikely(initialsize > maxsize)
+		{
+			exception_set(err, EINVAL, "Initial buffer pool size (%zu bytes) is larger than the maximum size (%zu bytes)", initialsize, maxsize);
+			return false;
+		}
+
+		if unlikely((uint64_t)maxsize / BUFFER_PAGESIZE >= (UINT64_C(1) << (64 - DEPOT_TAGBITS)) - 1)
+		{
+			exception_set(err, EINVAL, "Maximum buffer pool size (%zu bytes) has more pages than a depot head can address", maxsize);
+			return false;
+		}
+	}
+
+	pthread_key_create(&cachekey, cache_destroy);
+	list_init(&caches);
+	mutex_init(&cachelock, M_NORMAL);
+	mutex_init(&growlock, M_NORMAL);
+	mutex_init(&waitlock, M_NORMAL);
+	cond_init(&waitcond);
+
+	// Reserve (but don't back) the address space for the largest pool, aligned to the arena size for huge pages
+	reserved = ((maxsize + BUFFER_ARENASIZE - 1) / BUFFER_ARENASIZE) * BUFFER_ARENASIZE;
+	void * region = mmap(NULL, reserved + BUFFER_ARENASIZE, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+	if (region == MAP_FAILED)
+	{
+		exception_set(err, ENOMEM, "Could not reserve buffer space, currently set to %zu bytes: %s", maxsize, strerror(errno));
+		memory = NULL;
+		return false;
+	}
+
+	memory = (void *)(((uintptr_t)region + BUFFER_ARENASIZE - 1) & ~((uintptr_t)BUFFER_ARENASIZE - 1));
+	if (memory > region)											munmap(region, memory - region);
+	if (memory + reserved < region + reserved + BUFFER_ARENASIZE)	munmap(memory + reserved, (region + reserved + BUFFER_ARENASIZE) - (memory + reserved));
+
+	// Side table of page metadata, only touched (and backed) as arenas get used
+	metadata = mmap(NULL, (reserved / BUFFER_PAGESIZE) * sizeof(meta_t), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+	if (metadata == MAP_FAILED)
+	{
+		exception_set(err, ENOMEM, "Could not allocate buffer page metadata: %s", strerror(errno));
+		munmap(memory, reserved);
+		memory = metadata = NULL;
+		return false;
+	}
+
+	hugearenas = malloc(sizeof(bool) * (reserved / BUFFER_ARENASIZE));
+	memset(hugearenas, 0, sizeof(bool) * (reserved / BUFFER_ARENASIZE));
+
+	mapped = 0;
+	poolflags = flags;
+	hugepages = (flags & BUFFER_HUGEPAGES) != 0;
+
+	size_t arenas = max((initialsize + BUFFER_ARENASIZE - 1) / BUFFER_ARENASIZE, (size_t)1);
+	if (!pool_grow(arenas))
+	{
+		exception_set(err, ENOMEM, "Could not allocate buffer space, currently set to %zu bytes: %s", initialsize, strerror(errno));
+		return false;
+	}
+
+	// Create zero page
+	{
+		page_t * zeropage = getfree();
+		if unlikely(zeropage == NULL)
+		{
+			exception_set(err, EFAULT, "Could not allocate zero page!");
+			return false;
+		}
+
+		initpage(zeropage);
+		zero = zeropage;
+	}
+
+	return true;
+}
+
+void buffer_destroy()
+{
+	// Empty the depot and this thread's cache
+	depot = released = emergency = 0;
+	pages_free = pages_released = pages_highwater = alloc_failures = 0;
+	large_extents = large_bytes = 0;
+	pages_reserved = waits = wait_timeouts = reserve_allocs = reclaimed = inline_overflows = 0;
+	waitnanos = reservepages = numreclaimers = 0;
+	cache.count = 0;
+	cache.registered = false;
+	pthread_setspecific(cachekey, NULL);
+
+	if (memory != NULL)
+	{
+		munmap(memory, reserved);
+		munmap(metadata, (reserved / BUFFER_PAGESIZE) * sizeof(meta_t));
+		memory = metadata = NULL;
+		reserved = mapped = 0;
+	}
+
+	free(hugearenas);
+	hugearenas = NULL;
+
+	pthread_key_delete(cachekey);
+	mutex_destroy(&cachelock);
+	mutex_destroy(&growlock);
+	mutex_destroy(&waitlock);
+	pthread_cond_destroy(&waitcond);
+}
+
+void buffer_setwatermarks(size_t low, size_t high)
+{
+	lowwater = low / BUFFER_PAGESIZE;
+	highwater = high / BUFFER_PAGESIZE;
+}
+
+void buffer_setpolicy(uint64_t waitnanoseconds, size_t reservesize)
+{
+	waitnanos = waitnanoseconds;
+	reservepages = reservesize / BUFFER_PAGESIZE;
+
+	// Fill the emergency reserve right away
+	buffer_maintain();
+}
+
+void buffer_setrealtime(bool realtime)
+{
+	cache.realtime = realtime;
+}
+
+bool buffer_addreclaimer(bufferreclaim_f reclaim, void * userdata)
+{
+	// Sanity check
+	{
+		if unlikely(reclaim == NULL)
+		{
+			return false;
+		}
+	}
+
+	bool success = false;
+	mutex_lock(&growlock);
+	{
+		if (numreclaimers < MAX_RECLAIMERS)
+		{
+			reclaimers[numreclaimers].reclaim = reclaim;
+			reclaimers[numreclaimers].userdata = userdata;
+			numreclaimers += 1;
+			success = true;
+		}
+	}
+	mutex_unlock(&growlock);
+
+	return success;
+}
+
+void buffer_maintain()
+{
+	// Top up the emergency reserve from the depot
+	while (pages_reserved < reservepages)
+	{
+		magazine_t * magazine = pool_take();
+		if (magazine == NULL)
+		{
+			break;
+		}
+
+		depot_push(&emergency, magazine);
+		atomic_add(pages_reserved, magazine->count + 1);
+	}
+
+	// Hand the surplus back when the reserve was made smaller (this wakes any waiters)
+	while (pages_reserved >= reservepages + MAGAZINE_SIZE)
+	{
+		magazine_t * magazine = depot_pop(&emergency);
+		if (magazine == NULL)
+		{
+			break;
+		}
+
+		atomic_sub(pages_reserved, magazine->count + 1);
+		depot_push(&depot, magazine);
+	}
+
+	// Grow the pool ahead of demand when free pages drop below the low watermark
+	if (lowwater > 0 && pages_free < lowwater && mapped < reserved)
+	{
+		pool_grow((lowwater - pages_free) / (BUFFER_ARENASIZE / BUFFER_PAGESIZE) + 1);
+	}
+
+	// Give memory back to the OS while resident free pages are over the high watermark
+	while (highwater > 0 && (pages_free - pages_released - pages_reserved) > highwater)
+	{
+		magazine_t * magazine = depot_pop(&depot);
+		if (magazine == NULL)
+		{
+			break;
+		}
+
+		if (!pool_release(magazine))
+		{
+			// Memory can't be released (eg. the pool is backed by MAP_HUGETLB pages)
+			depot_push(&depot, magazine);
+			break;
+		}
+
+		depot_push(&released, magazine);
+		atomic_add(pages_released, magazine->count);
+	}
+}
+
+void buffer_stats(bufferstats_t * stats)
+{
+	// Sanity check
+	{
+		if unlikely(stats == NULL)
+		{
+			return;
+		}
+	}
+
+	size_t cached = 0;
+	mutex_lock(&cachelock);
+	{
+		list_t * pos = NULL;
+		list_foreach(pos, &caches)
+		{
+			cached += list_entry(pos, cache_t, cache_list)->count;
+		}
+	}
+	mutex_unlock(&cachelock);
+
+	memset(stats, 0, sizeof(bufferstats_t));
+	stats->arenas = mapped / BUFFER_ARENASIZE;
+	for (size_t i = 0; i < stats->arenas; i++)
+	{
+		stats->arenas_huge += (hugearenas[i])? 1 : 0;
+	}
+	stats->hugepages = stats->arenas > 0 && stats->arenas_huge == stats->arenas;
+	stats->pages_total = mapped / BUFFER_PAGESIZE;
+	stats->pages_free = pages_free + cached;
+	stats->pages_released = pages_released;
+	stats->pages_inuse = stats->pages_total - min(stats->pages_total, stats->pages_free);
+	stats->pages_highwater = pages_highwater;
+	stats->alloc_failures = alloc_failures;
+	stats->large_extents = large_extents;
+	stats->large_bytes = large_bytes;
+	stats->pages_reserved = pages_reserved;
+	stats->waits = waits;
+	stats->wait_timeouts = wait_timeouts;
+	stats->reserve_allocs = reserve_allocs;
+	stats->reclaimed = reclaimed;
+	stats->inline_overflows = inline_overflows;
+}
+
+buffer_t * buffer_new()
+{
+	page_t * page = getfree();
+	if unlikely(page == NULL)
+	{
+		return NULL;
+	}
+
+	initpage(page);
+	return (buffer_t *)page;
+}
+
+buffer_t * buffer_newlarge(size_t capacity)
+{
+	large_t * large = getfree();
+	if unlikely(large == NULL)
+	{
+		return NULL;
+	}
+
+	extent_t * extent = extent_new(capacity);
+	if unlikely(extent == NULL)
+	{
+		putfree(large);
+		return NULL;
+	}
+
+	pagemeta(large)->type = TYPE_LARGE;
+	pagemeta(large)->refs = 1;
+	large->base = 0;
+	large->size = 0;
+	large->extent = extent;
+
+	return (buffer_t *)large;
+}
+
+buffer_t * buffer_newinline(void * storage)
+{
+	// Sanity check
+	{
+		if unlikely(storage == NULL)
+		{
+			return NULL;
+		}
+	}
+
+	inline_t * in = storage;
+	in->size = 0;
+
+	return (buffer_t *)in;
+}
+
+bool buffer_isinline(const buffer_t * buffer)
+{
+	return buffer != NULL && isinline(buffer);
+}
+
+buffer_t * buffer_dup(const buffer_t * src)
+{
+	// Sanity check
+	{
+		if unlikely(src == NULL)
+		{
+			return NULL;
+		}
+	}
+
+	if unlikely(isinline(src))
+	{
+		const inline_t * in = (const inline_t *)src;
+		return inline_copy(in, 0, in->size);
+	}
+
+	if (pagemeta(src)->type == TYPE_PAGE)
+	{
+		// Src is a small buffer, the page is the src handle itself so it can't be shared
+		// Copy just the used bytes into a new small buffer
+
+		size_t size = 0;
+		const page_t * page = smallpage(src, &size);
+
+		page_t * new = getfree();
+		if unlikely(new == NULL)
+		{
+			return NULL;
+		}
+
+		pagemeta(new)->type = TYPE_PAGE;
+		pagemeta(new)->refs = 1;
+		memcpy(new->data, page->data, size);
+		*smallpage_size(new) = size;		// Writes past the size zero any gap first, so the stale tail is never seen
+
+		return (buffer_t *)new;
+	}
+	else if (pagemeta(src)->type == TYPE_BUFFER)
+	{
+		// Src points to a buffer, do a shallow copy of the index
+
+		buffer_t * buffer = getfree();
+		if unlikely(buffer == NULL)
+		{
+			return NULL;
+		}
+
+		initbuffer(buffer);
+		buffer->base = src->base;
+		buffer->size = src->size;
+
+		for (size_t index = 0; index < PAGES_PER_BUFFER; index++)
+		{
+			page_t * page = src->pages[index];
+			if (page != NULL)
+			{
+				atomic_inc(pagemeta(page)->refs);
+				buffer->pages[index] = page;
+			}
+		}
+
+		for (size_t index = 0; index < TABLES_PER_BUFFER; index++)
+		{
+			table_t * table = src->tables[index];
+			if (table != NULL)
+			{
+				atomic_inc(pagemeta(table)->refs);
+				buffer->tables[index] = table;
+			}
+		}
+
+		return buffer;
+	}
+	else if (pagemeta(src)->type == TYPE_LARGE)
+	{
+		// Src points to a large buffer, share the extent
+
+		return buffer_slice(src, 0, buffer_size(src));
+	}
+
+	return NULL;
+}
+
+buffer_t * buffer_ref(const buffer_t * buffer)
+{
+	// Sanity check
+	{
+		if unlikely(buffer == NULL)
+		{
+			return NULL;
+		}
+	}
+
+	if unlikely(isinline(buffer) || pagemeta(buffer)->refs == UINT16_MAX)
+	{
+		// Inline storage isn't refcounted (and the count is full), hand out a copy instead
+		return buffer_dup(buffer);
+	}
+
+	atomic_inc(pagemeta(buffer)->refs);
+	return (buffer_t *)buffer;
+}
+
+bool buffer_isshared(const buffer_t * buffer)
+{
+	return buffer != NULL && !isinline(buffer) && atomic_get(pagemeta(buffer)->refs) > 1;
+}
+
+buffer_t * buffer_slice(const buffer_t * src, off_t offset, size_t length)
+{
+	// Sanity check
+	{
+		if unlikely(src == NULL || offset < 0)
+		{
+			return NULL;
+		}
+	}
+
+	// Clip the slice to the source buffer
+	size_t size = buffer_size(src);
+	offset = min((size_t)offset, size);
+	length = min(length, size - offset);
+
+	if unlikely(isinline(src))
+	{
+		return inline_copy((const inline_t *)src, offset, length);
+	}
+
+	if (pagemeta(src)->type == TYPE_PAGE)
+	{
+		// Copy the (less than one page of) data into a new small buffer
+
+		page_t * page = getfree();
+		if unlikely(page == NULL)
+		{
+			return NULL;
+		}
+
+		initpage(page);
+		memcpy(page->data, &smallpage(src, &size)->data[offset], length);
+		*smallpage_size(page) = length;
+
+		return (buffer_t *)page;
+	}
+	else if (pagemeta(src)->type == TYPE_BUFFER)
+	{
+		// Src points to a buffer, reference the pages that cover the slice
+
+		buffer_t * buffer = getfree();
+		if unlikely(buffer == NULL)
+		{
+			return NULL;
+		}
+
+		initbuffer(buffer);
+		buffer->base = (src->base + offset) % BYTES_PER_PAGE;
+		buffer->size = length;
+
+		size_t first = (src->base + offset) / BYTES_PER_PAGE;
+		size_t pages = (buffer->base + length + BYTES_PER_PAGE - 1) / BYTES_PER_PAGE;
+
+		for (size_t index = 0; index < pages; index++)
+		{
+			page_t * page = getpage(src, first + index);
+			if (page == NULL)
+			{
+				// Leave holes as holes
+				continue;
+			}
+
+			page_t ** slot = pageslot(buffer, index);
+			if unlikely(slot == NULL)
+			{
+				// Out of buffer memory!
+				buffer_free(buffer);
+				return NULL;
+			}
+
+			atomic_inc(pagemeta(page)->refs);
+			*slot = page;
+		}
+
+		return buffer;
+	}
+	else if (pagemeta(src)->type == TYPE_LARGE)
+	{
+		// Src points to a large buffer, reference the same extent
+
+		const large_t * srclarge = (const large_t *)src;
+
+		large_t * large = getfree();
+		if unlikely(large == NULL)
+		{
+			return NULL;
+		}
+
+		atomic_inc(srclarge->extent->refs);
+
+		pagemeta(large)->type = TYPE_LARGE;
+		pagemeta(large)->refs = 1;
+		large->base = srclarge->base + offset;
+		large->size = length;
+		large->extent = srclarge->extent;
+
+		return (buffer_t *)large;
+	}
+
+	return NULL;
+}
+
+size_t buffer_write(buffer_t * buffer, const void * data, off_t offset, size_t length)
+{
+	// Sanity check
+	{
+		if unlikely(buffer == NULL || data == NULL || offset < 0)
 		{
 			return 0;
 		}
+	}
 
-		size_t bytes = min(length, size - offset);
-		memcpy(data, &page->data[offset], bytes);
-		return bytes;
+	if unlikely(isinline(buffer))
+	{
+		inline_t * in = (inline_t *)buffer;
+		if (!inline_fill(in, offset, length))
+		{
+			return 0;
+		}
+
+		memcpy(&in->data[offset], data, length);
+		in->size = max(in->size, offset + length);
+		return length;
 	}
-	else if (buffer->type == TYPE_BUFFER)
+
+	if ((size_t)offset + length > LARGE_THRESHOLD && pagemeta(buffer)->type != TYPE_LARGE)
 	{
-		while ((size_t)offset >= BYTES_PER_BUFFER)
+		// Growing past the threshold, move the data to a contiguous extent
+		if ((buffer = enlarge(buffer, offset + length)) == NULL)
 		{
-			buffer = buffer->next;
-			offset -= BYTES_PER_BUFFER;
+			return 0;
+		}
+	}
+
+	if (pagemeta(buffer)->type == TYPE_PAGE)
+	{
+		// We are writing to a single page
+		size_t ensuresize = offset + length;
 
-			if (buffer == NULL)
+		if (ensuresize > BYTES_PER_SMALLPAGE)
+		{
+			// We need more room than this page, promote this page to a full buffer
+			// Let the next root if-statement catch it and do the writing
+			if ((buffer = promote(buffer)) == NULL)
 			{
+				// Could not promote buffer (probably due to not enough free buffers)
 				return 0;
 			}
 		}
+		else
+		{
+			// We have enough room in this page to write the data
+			page_t * page = (page_t *)buffer;
+			uint16_t * size = smallpage_size(page);
+			if (offset > *size)
+			{
+				// Make sure that the memory between page->size and offset are filled with zeros
+				memset(&page->data[*size], 0, offset - *size);
+			}
 
-		if ((size_t)offset >= buffer->size)
+			memcpy(&page->data[offset], data, length);
+			*size = max(*size, ensuresize);
+
+			return length;
+		}
+	}
+
+	if (pagemeta(buffer)->type == TYPE_BUFFER)
+	{
+		if ((size_t)offset > buffer->size && !cleartail(buffer, offset))
 		{
 			return 0;
 		}
 
-		size_t totalread = 0;
-		size_t pagenum = offset / BYTES_PER_PAGE;
-		off_t pageoff = offset % BYTES_PER_PAGE;
-		size_t left = buffer->size - offset;
+		size_t totalwrote = 0;
+		size_t pagenum = (buffer->base + offset) / BYTES_PER_PAGE;
+		off_t pageoff = (buffer->base + offset) % BYTES_PER_PAGE;
+		size_t given = offset;
 
 		while (length > 0)
 		{
-			if (pagenum == PAGES_PER_BUFFER)
+			page_t * page = writepage(buffer, pagenum);
+			if unlikely(page == NULL)
 			{
-				// Overflow this buffer, start reading from the next one
-				buffer = buffer->next;
-				if (buffer->next == NULL)
-				{
-					break;
-				}
+				// Could not allocate free page (or the buffer is full)
+				return totalwrote;
+			}
 
-				left = buffer->size;
-				pagenum = pageoff = 0;
+			// Determine how many bytes to write
+			size_t writelen = min(length, BYTES_PER_PAGE - pageoff);
 
-				continue;
-			}
+			// Memcpy the bytes
+			memcpy(&page->data[pageoff], data, writelen);
 
-			const page_t * page = buffer->pages[pagenum];
+			// Update the buffer size parameter
+			given += writelen;
+			buffer->size = max(buffer->size, given);
 
-			// Check for null page
-			if (page == NULL)
-			{
-				page = zero;
-			}
+			// Update the loop tracking variables
+			length -= writelen;
+			data += writelen;
+			totalwrote += writelen;
+			pagenum += 1;
+			pageoff = 0;
+		}
+
+		return totalwrote;
+	}
+	else if (pagemeta(buffer)->type == TYPE_LARGE)
+	{
+		large_t * large = (large_t *)buffer;
+		if (!large_ensure(large, offset + length) || !large_fill(large, offset))
+		{
+			// Could not allocate extent
+			return 0;
+		}
+
+		memcpy(extent_data(large->extent) + large->base + offset, data, length);
+		large->size = max(large->size, offset + length);
+
+		return length;
+	}
+
+	return 0;
+}
+
+size_t buffer_read(const buffer_t * buffer, void * data, off_t offset, size_t length)
+{
+	// Sanity check
+	{
+		if unlikely(buffer == NULL || data == NULL || offset < 0)
+		{
+			return 0;
+		}
+	}
+
+	if unlikely(isinline(buffer))
+	{
+		const inline_t * in = (const inline_t *)buffer;
+		if ((size_t)offset >= in->size)
+		{
+			return 0;
+		}
+
+		size_t bytes = min(length, in->size - offset);
+		memcpy(data, &in->data[offset], bytes);
+		return bytes;
+	}
+
+	if (pagemeta(buffer)->type == TYPE_PAGE)
+	{
+		size_t size = 0;
+		const page_t * page = smallpage(buffer, &size);
+		if ((size_t)offset >= size)
+		{
+			return 0;
+		}
+
+		size_t bytes = min(length, size - offset);
+		memcpy(data, &page->data[offset], bytes);
+		return bytes;
+	}
+	else if (pagemeta(buffer)->type == TYPE_BUFFER)
+	{
+		if ((size_t)offset >= buffer->size)
+		{
+			return 0;
+		}
+
+		size_t totalread = 0;
+		size_t pagenum = (buffer->base + offset) / BYTES_PER_PAGE;
+		off_t pageoff = (buffer->base + offset) % BYTES_PER_PAGE;
+		size_t left = buffer->size - offset;
+
+		while (length > 0 && left > 0)
+		{
+			const page_t * page = readpage(buffer, pagenum);
 
 			// Determine how many bytes to read
 			size_t readlen = min(length, left, BYTES_PER_PAGE - pageoff);
-			if (readlen == 0)
-			{
-				break;
-			}
 
 			// Read the bytes
 			memcpy(data, &page->data[pageoff], readlen);
@@ -480,6 +1693,18 @@ size_t buffer_read(const buffer_t * buffer, void * data, off_t offset, size_t le
 
 		return totalread;
 	}
+	else if (pagemeta(buffer)->type == TYPE_LARGE)
+	{
+		const large_t * large = (const large_t *)buffer;
+		if ((size_t)offset >= large->size)
+		{
+			return 0;
+		}
+
+		size_t bytes = min(length, large->size - offset);
+		memcpy(data, extent_data(large->extent) + large->base + offset, bytes);
+		return bytes;
+	}
 
 	return 0;
 }
@@ -495,99 +1720,278 @@ ssize_t buffer_send(const buffer_t * buffer, int fd, off_t offset, size_t length
 		}
 	}
 
-	if (buffer->type == TYPE_PAGE)
+	if unlikely(isinline(buffer))
 	{
-		const page_t * page = (const page_t *)buffer;
-		size_t size = *smallpage_size(page);
+		const inline_t * in = (const inline_t *)buffer;
+		if ((size_t)offset >= in->size)
+		{
+			return 0;
+		}
+
+		return write(fd, &in->data[offset], min(length, in->size - offset));
+	}
+
+	if (pagemeta(buffer)->type == TYPE_PAGE)
+	{
+		size_t size = 0;
+		const page_t * page = smallpage(buffer, &size);
 		if ((size_t)offset >= size)
 		{
-			return 0;
+			return 0;
+		}
+
+		size_t bytes = min(length, size - offset);
+		return write(fd, &page->data[offset], bytes);
+	}
+	else if (pagemeta(buffer)->type == TYPE_BUFFER)
+	{
+		if ((size_t)offset >= buffer->size)
+		{
+			return 0;
+		}
+
+		// Send at most IOV_MAX pages in one go, the caller will see a short write for the rest
+		size_t numvectors = min(length / BYTES_PER_PAGE + 2, (size_t)IOV_MAX);
+
+		size_t index = 0;
+		struct iovec vector[numvectors];
+
+		size_t pagenum = (buffer->base + offset) / BYTES_PER_PAGE;
+		off_t pageoff = (buffer->base + offset) % BYTES_PER_PAGE;
+		size_t left = buffer->size - offset;
+
+		while (length > 0 && left > 0 && index < numvectors)
+		{
+			const page_t * page = readpage(buffer, pagenum);
+
+			// Determine how many bytes to read
+			size_t readlen = min(length, left, BYTES_PER_PAGE - pageoff);
+
+			// Read the bytes
+			vector[index].iov_base = (void *)&page->data[pageoff];		// Remove the const. Really iovec? That's just poor spec design!
+			vector[index].iov_len = readlen;
+			index += 1;
+
+			// Update the loop tracking variables
+			length -= readlen;
+			left -= readlen;
+			pagenum += 1;
+			pageoff = 0;
+		}
+
+		if (index == 0)
+		{
+			return 0;
+		}
+
+		return writev(fd, vector, index);
+	}
+	else if (pagemeta(buffer)->type == TYPE_LARGE)
+	{
+		const large_t * large = (const large_t *)buffer;
+		if ((size_t)offset >= large->size)
+		{
+			return 0;
+		}
+
+		size_t bytes = min(length, large->size - offset);
+		return write(fd, extent_data(large->extent) + large->base + offset, bytes);
+	}
+
+	errno = EINVAL;
+	return -1;
+}
+
+static ssize_t buffer_readv(buffer_t * buffer, int fd, off_t offset, off_t fileoffset, size_t length)
+{
+	// Sanity check
+	{
+		if unlikely(buffer == NULL || offset < 0)
+		{
+			errno = EINVAL;
+			return -1;
+		}
+	}
+
+	// Read with preadv from fileoffset, or with readv from the current position when fileoffset is negative
+	#define doread(vector, count) \
+		((fileoffset < 0)? readv(fd, (vector), (count)) : preadv(fd, (vector), (count), fileoffset))
+
+	if unlikely(isinline(buffer))
+	{
+		inline_t * in = (inline_t *)buffer;
+		if unlikely((size_t)offset >= BUFFER_INLINECAPACITY && length > 0)
+		{
+			inline_overflow(offset, length);
+			errno = ENOSPC;
+			return -1;
+		}
+
+		length = min(length, BUFFER_INLINECAPACITY - offset);
+		inline_fill(in, offset, length);
+
+		struct iovec vector = { &in->data[offset], length };
+		ssize_t bytes = doread(&vector, 1);
+		if (bytes > 0)
+		{
+			in->size = max(in->size, (size_t)(offset + bytes));
+		}
+
+		return bytes;
+	}
+
+	if ((size_t)offset + length > LARGE_THRESHOLD && pagemeta(buffer)->type != TYPE_LARGE)
+	{
+		// Growing past the threshold, move the data to a contiguous extent
+		if ((buffer = enlarge(buffer, offset + length)) == NULL)
+		{
+			errno = ENOMEM;
+			return -1;
 		}
-
-		size_t bytes = min(length, size - offset);
-		return write(fd, &page->data[offset], bytes);
 	}
-	else if (buffer->type == TYPE_BUFFER)
+
+	if (pagemeta(buffer)->type == TYPE_PAGE)
 	{
-		size_t numvectors = length / BYTES_PER_PAGE + 2;
+		size_t ensuresize = offset + length;
 
-		// Find starting buffer
-		while ((size_t)offset >= BYTES_PER_BUFFER)
+		if (ensuresize > BYTES_PER_SMALLPAGE)
 		{
-			buffer = buffer->next;
-			offset -= BYTES_PER_BUFFER;
-
-			if (buffer == NULL)
+			// The data may not fit in this page, promote this page to a full buffer
+			if ((buffer = promote(buffer)) == NULL)
 			{
-				return 0;
+				errno = ENOMEM;
+				return -1;
 			}
 		}
+		else
+		{
+			page_t * page = (page_t *)buffer;
+			uint16_t * size = smallpage_size(page);
+			if (offset > *size)
+			{
+				// Make sure that the memory between page->size and offset are filled with zeros
+				memset(&page->data[*size], 0, offset - *size);
+			}
 
-		size_t index = 0;
-		struct iovec vector[numvectors];
-		memset(vector, 0, sizeof(struct iovec) * numvectors);
-
+			struct iovec vector = { &page->data[offset], length };
+			ssize_t bytes = doread(&vector, 1);
+			if (bytes > 0)
+			{
+				*size = max(*size, (size_t)offset + bytes);
+			}
 
-		size_t pagenum = offset / BYTES_PER_PAGE;
-		off_t pageoff = offset % BYTES_PER_PAGE;
-		size_t left = buffer->size - offset;
+			return bytes;
+		}
+	}
 
-		while (length > 0)
+	if (pagemeta(buffer)->type == TYPE_BUFFER)
+	{
+		if ((size_t)offset > buffer->size && !cleartail(buffer, offset))
 		{
-			if (pagenum == PAGES_PER_BUFFER)
-			{
-				// Overflow this buffer, start reading from the next one
-				buffer = buffer->next;
-				if (buffer->next == NULL)
-				{
-					break;
-				}
+			errno = ENOMEM;
+			return -1;
+		}
 
-				left = buffer->size;
-				pagenum = pageoff = 0;
+		// Read into at most IOV_MAX pages in one go, the caller will see a short read for the rest
+		size_t numvectors = min(length / BYTES_PER_PAGE + 2, (size_t)IOV_MAX);
 
-				continue;
-			}
+		size_t index = 0;
+		struct iovec vector[numvectors];
 
-			const page_t * page = buffer->pages[pagenum];
+		size_t pagenum = (buffer->base + offset) / BYTES_PER_PAGE;
+		off_t pageoff = (buffer->base + offset) % BYTES_PER_PAGE;
 
-			// Check for null page
-			if (page == NULL)
+		while (length > 0 && index < numvectors)
+		{
+			page_t * page = writepage(buffer, pagenum);
+			if unlikely(page == NULL)
 			{
-				page = zero;
+				// Could not allocate free page (or the buffer is full)
+				break;
 			}
 
 			// Determine how many bytes to read
-			size_t readlen = min(length, left, BYTES_PER_PAGE - pageoff);
-			if (readlen == 0)
-			{
-				break;
-			}
+			size_t readlen = min(length, BYTES_PER_PAGE - pageoff);
 
-			// Read the bytes
-			vector[index].iov_base = (void *)&page->data[pageoff];		// Remove the const. Really iovec? That's just poor spec design!
+			vector[index].iov_base = &page->data[pageoff];
 			vector[index].iov_len = readlen;
 			index += 1;
 
 			// Update the loop tracking variables
 			length -= readlen;
-			left -= readlen;
 			pagenum += 1;
 			pageoff = 0;
 		}
 
 		if (index == 0)
 		{
-			return 0;
+			errno = ENOMEM;
+			return -1;
 		}
 
-		return writev(fd, vector, index);
+		ssize_t bytes = doread(vector, index);
+		if (bytes > 0)
+		{
+			buffer->size = max(buffer->size, (size_t)offset + bytes);
+		}
+
+		// Give back the pages past the end of the buffer that a short read didn't reach
+		for (size_t trim = (buffer->base + buffer->size + BYTES_PER_PAGE - 1) / BYTES_PER_PAGE; trim < pagenum; trim++)
+		{
+			page_t ** slot = pageslot(buffer, trim);
+			if (slot != NULL && *slot != NULL)
+			{
+				droppage(*slot);
+				*slot = NULL;
+			}
+		}
+
+		return bytes;
+	}
+	else if (pagemeta(buffer)->type == TYPE_LARGE)
+	{
+		large_t * large = (large_t *)buffer;
+		if (!large_ensure(large, offset + length) || !large_fill(large, offset))
+		{
+			errno = ENOMEM;
+			return -1;
+		}
+
+		struct iovec vector = { extent_data(large->extent) + large->base + offset, length };
+		ssize_t bytes = doread(&vector, 1);
+		if (bytes > 0)
+		{
+			large->size = max(large->size, (size_t)offset + bytes);
+		}
+
+		return bytes;
 	}
 
+	#undef doread
+
 	errno = EINVAL;
 	return -1;
 }
 
+ssize_t buffer_recv(buffer_t * buffer, int fd, off_t offset, size_t length)
+{
+	return buffer_readv(buffer, fd, offset, -1, length);
+}
+
+ssize_t buffer_recvfile(buffer_t * buffer, int fd, off_t offset, off_t fileoffset, size_t length)
+{
+	// Sanity check
+	{
+		if unlikely(fileoffset < 0)
+		{
+			errno = EINVAL;
+			return -1;
+		}
+	}
+
+	return buffer_readv(buffer, fd, offset, fileoffset, length);
+}
+
 size_t buffer_size(const buffer_t * buffer)
 {
 	// Sanity check
@@ -598,21 +2002,24 @@ size_t buffer_size(const buffer_t * buffer)
 		}
 	}
 
-	if (buffer->type == TYPE_PAGE)
+	if unlikely(isinline(buffer))
+	{
+		return ((const inline_t *)buffer)->size;
+	}
+
+	if (pagemeta(buffer)->type == TYPE_PAGE)
 	{
 		const page_t * page = (const page_t *)buffer;
 		return *smallpage_size(page);
 	}
-	else if (buffer->type == TYPE_BUFFER)
+	else if (pagemeta(buffer)->type == TYPE_BUFFER)
 	{
-		const buffer_t * next = buffer->next;
-		if (next != NULL)
-		{
-			return buffer->size + buffer_size(next);
-		}
-
 		return buffer->size;
 	}
+	else if (pagemeta(buffer)->type == TYPE_LARGE)
+	{
+		return ((const large_t *)buffer)->size;
+	}
 
 	return 0;
 }
@@ -627,29 +2034,30 @@ void buffer_free(buffer_t * buffer)
 		}
 	}
 
-	if (buffer->type == TYPE_PAGE)
+	if unlikely(isinline(buffer))
 	{
-		putfree(buffer);
+		// The storage belongs to whoever created the inline buffer
+		return;
 	}
-	else if (buffer->type == TYPE_BUFFER)
-	{
-		for (size_t index = 0; index < PAGES_PER_BUFFER; index++)
-		{
-			page_t * page = buffer->pages[index];
-			if (page != NULL)
-			{
-				if (atomic_dec(page->refs) == 0)
-				{
-					putfree(page);
-				}
-			}
-		}
 
-		if (buffer->next != NULL)
-		{
-			buffer_free(buffer->next);
-		}
+	if (atomic_dec(pagemeta(buffer)->refs) != 0)
+	{
+		// Someone else still holds a reference to this handle (see buffer_ref)
+		return;
+	}
 
+	if (pagemeta(buffer)->type == TYPE_PAGE)
+	{
+		putfree(buffer);
+	}
+	else if (pagemeta(buffer)->type == TYPE_LARGE)
+	{
+		extent_drop(((large_t *)buffer)->extent);
+		putfree(buffer);
+	}
+	else if (pagemeta(buffer)->type == TYPE_BUFFER)
+	{
+		dropbuffer(buffer);
 		putfree(buffer);
 	}
 }
@@ -709,6 +2117,230 @@ ssize_t bufferpos_send(bufferpos_t * pos, int fd, size_t length)
 	return sent;
 }
 
+ssize_t bufferpos_recv(bufferpos_t * pos, int fd, size_t length)
+{
+	// Sanity check
+	{
+		if unlikely(pos == NULL)
+		{
+			return 0;
+		}
+	}
+
+	ssize_t received = buffer_recv(pos->buffer, fd, pos->offset, length);
+	pos->offset += (received < 0)? 0 : received;
+
+	return received;
+}
+
+void * buffer_reserve(bufferpos_t * pos, size_t length)
+{
+	// Sanity check
+	{
+		if unlikely(pos == NULL || pos->buffer == NULL || pos->offset < 0)
+		{
+			return NULL;
+		}
+	}
+
+	buffer_t * buffer = pos->buffer;
+	size_t offset = pos->offset;
+
+	if unlikely(isinline(buffer))
+	{
+		inline_t * in = (inline_t *)buffer;
+		return inline_fill(in, offset, length)? &in->data[offset] : NULL;
+	}
+
+	if ((size_t)offset + length > LARGE_THRESHOLD && pagemeta(buffer)->type != TYPE_LARGE)
+	{
+		// Growing past the threshold, move the data to a contiguous extent
+		if (enlarge(buffer, offset + length) == NULL)
+		{
+			return NULL;
+		}
+	}
+
+	if (pagemeta(buffer)->type == TYPE_PAGE)
+	{
+		if (offset + length > BYTES_PER_SMALLPAGE)
+		{
+			// Doesn't fit in a small buffer, promote it and reserve from the full buffer below
+			if (promote(buffer) == NULL)
+			{
+				return NULL;
+			}
+		}
+		else
+		{
+			page_t * page = (page_t *)buffer;
+			uint16_t * size = smallpage_size(page);
+			if (offset > *size)
+			{
+				// Make sure that the memory between page->size and offset are filled with zeros
+				memset(&page->data[*size], 0, offset - *size);
+			}
+
+			return &page->data[offset];
+		}
+	}
+
+	if (pagemeta(buffer)->type == TYPE_BUFFER)
+	{
+		off_t pageoff = (buffer->base + offset) % BYTES_PER_PAGE;
+		if (pageoff + length > BYTES_PER_PAGE)
+		{
+			// The span would cross into the next page
+			return NULL;
+		}
+
+		if (offset > buffer->size && !cleartail(buffer, offset))
+		{
+			return NULL;
+		}
+
+		page_t * page = writepage(buffer, (buffer->base + offset) / BYTES_PER_PAGE);
+		if unlikely(page == NULL)
+		{
+			return NULL;
+		}
+
+		return &page->data[pageoff];
+	}
+	else if (pagemeta(buffer)->type == TYPE_LARGE)
+	{
+		// Large buffers are contiguous, any span fits
+		large_t * large = (large_t *)buffer;
+		if (!large_ensure(large, offset + length) || !large_fill(large, offset))
+		{
+			return NULL;
+		}
+
+		return extent_data(large->extent) + large->base + offset;
+	}
+
+	return NULL;
+}
+
+void buffer_commit(bufferpos_t * pos, size_t length)
+{
+	// Sanity check
+	{
+		if unlikely(pos == NULL || pos->buffer == NULL)
+		{
+			return;
+		}
+	}
+
+	buffer_t * buffer = pos->buffer;
+	pos->offset += length;
+
+	if unlikely(isinline(buffer))
+	{
+		inline_t * in = (inline_t *)buffer;
+		in->size = max(in->size, (size_t)pos->offset);
+		return;
+	}
+
+	if (pagemeta(buffer)->type == TYPE_PAGE)
+	{
+		uint16_t * size = smallpage_size((page_t *)buffer);
+		*size = max(*size, (size_t)pos->offset);
+	}
+	else if (pagemeta(buffer)->type == TYPE_LARGE)
+	{
+		large_t * large = (large_t *)buffer;
+		large->size = max(large->size, (size_t)pos->offset);
+	}
+	else
+	{
+		buffer->size = max(buffer->size, (size_t)pos->offset);
+	}
+}
+
+const void * buffer_peek(const bufferpos_t * pos, size_t length)
+{
+	// Sanity check
+	{
+		if unlikely(pos == NULL || pos->buffer == NULL || pos->offset < 0)
+		{
+			return NULL;
+		}
+	}
+
+	const buffer_t * buffer = pos->buffer;
+	size_t offset = pos->offset;
+
+	if (offset + length > buffer_size(buffer))
+	{
+		return NULL;
+	}
+
+	if unlikely(isinline(buffer))
+	{
+		return &((const inline_t *)buffer)->data[offset];
+	}
+
+	if (pagemeta(buffer)->type == TYPE_PAGE)
+	{
+		size_t size = 0;
+		return &smallpage(buffer, &size)->data[offset];
+	}
+	else if (pagemeta(buffer)->type == TYPE_BUFFER)
+	{
+		off_t pageoff = (buffer->base + offset) % BYTES_PER_PAGE;
+		if (pageoff + length > BYTES_PER_PAGE)
+		{
+			// The span crosses into the next page
+			return NULL;
+		}
+
+		return &readpage(buffer, (buffer->base + offset) / BYTES_PER_PAGE)->data[pageoff];
+	}
+	else if (pagemeta(buffer)->type == TYPE_LARGE)
+	{
+		const large_t * large = (const large_t *)buffer;
+		return extent_data(large->extent) + large->base + offset;
+	}
+
+	return NULL;
+}
+
+size_t bufferpos_span(const bufferpos_t * pos)
+{
+	// Sanity check
+	{
+		if unlikely(pos == NULL || pos->buffer == NULL || pos->offset < 0)
+		{
+			return 0;
+		}
+	}
+
+	const buffer_t * buffer = pos->buffer;
+	size_t offset = pos->offset;
+
+	if unlikely(isinline(buffer))
+	{
+		return (offset < BUFFER_INLINECAPACITY)? BUFFER_INLINECAPACITY - offset : 0;
+	}
+
+	if (pagemeta(buffer)->type == TYPE_PAGE)
+	{
+		return (offset < BYTES_PER_SMALLPAGE)? BYTES_PER_SMALLPAGE - offset : 0;
+	}
+	else if (pagemeta(buffer)->type == TYPE_BUFFER)
+	{
+		return BYTES_PER_PAGE - (buffer->base + offset) % BYTES_PER_PAGE;
+	}
+	else if (pagemeta(buffer)->type == TYPE_LARGE)
+	{
+		// Contiguous all the way, growing it is reserve's business
+		return SIZE_MAX - offset;
+	}
+
+	return 0;
+}
+
 size_t bufferpos_remaining(const bufferpos_t * pos)
 {
 	// Sanity check
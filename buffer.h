@@ -9,26 +9,76 @@ extern "C" {
 #endif
 
 #define BUFFER_PAGESIZE		(4096)		// Must be less than 65536 (or 0x10000)
+#define BUFFER_ARENASIZE	(2 * 1024 * 1024)	// The pool grows in arenas of this size (one huge page)
+
+#define BUFFER_INLINESIZE	(4 * 64)	// Caller storage for an inline buffer (a few cache lines), see buffer_newinline
+#define BUFFER_INLINECAPACITY	(BUFFER_INLINESIZE - sizeof(size_t))
+
+#define BUFFER_HUGEPAGES	(1 << 0)	// Back the pool with huge pages (MAP_HUGETLB, falls back to transparent huge pages)
 
 typedef struct __buffer_t buffer_t;
+typedef size_t (*bufferreclaim_f)(void * userdata);		// Called when the pool is exhausted, frees buffers and returns how many were freed
 
 typedef struct
 {
-	// TODO - make this more intelligent (keep track of sub-buffers?)
+	// Cursor into a buffer, point it at a buffer_slice to work on part of a buffer
 	buffer_t * buffer;
 	off_t offset;
 } bufferpos_t;
 
+typedef struct
+{
+	bool hugepages;				// Every pool arena is backed by MAP_HUGETLB pages
+	size_t arenas;				// Number of arenas mapped into the pool
+	size_t arenas_huge;			// Of those, the ones backed by MAP_HUGETLB pages (the rest use normal or transparent huge pages)
+	size_t pages_total;			// Pages backed by the mapped arenas
+	size_t pages_free;			// Pages free to allocate (includes released pages)
+	size_t pages_released;		// Free pages whose memory has been given back to the OS
+	size_t pages_inuse;			// Pages currently allocated
+	size_t pages_highwater;		// Most pages ever taken out of the pool at once (magazine granularity)
+	size_t alloc_failures;		// Allocations that failed because the pool was exhausted
+	size_t large_extents;		// Contiguous extents backing large buffers
+	size_t large_bytes;			// Bytes mapped by large buffer extents
+	size_t pages_reserved;		// Free pages held in the emergency reserve (included in pages_free)
+	size_t waits;				// Allocations from non-realtime threads that waited for pages
+	size_t wait_timeouts;		// Waits that timed out without getting pages
+	size_t reserve_allocs;		// Allocations from realtime threads served from the emergency reserve
+	size_t reclaimed;			// Buffers freed by reclaimers (eg. evicted service packets)
+	size_t inline_overflows;	// Writes refused because they didn't fit an inline buffer
+} bufferstats_t;
+
 
-bool buffer_init(size_t poolsize, exception_t ** err);
+bool buffer_init(size_t initialsize, size_t maxsize, int flags, exception_t ** err);
 void buffer_destroy();
+void buffer_setwatermarks(size_t low, size_t high);
+void buffer_setpolicy(uint64_t waitnanoseconds, size_t reservesize);
+void buffer_setrealtime(bool realtime);
+bool buffer_addreclaimer(bufferreclaim_f reclaim, void * userdata);
+void buffer_maintain();
+void buffer_stats(bufferstats_t * stats);
 
 buffer_t * buffer_new();
+// Large buffers keep their data in one contiguous extent. Buffers that grow past a few MB are moved into one
+// automatically, buffer_newlarge starts out that way for payloads known to be big
+buffer_t * buffer_newlarge(size_t capacity);
+// Inline buffers live in BUFFER_INLINESIZE bytes of (8 byte aligned) caller storage rather than the pool. They hold at most
+// BUFFER_INLINECAPACITY bytes, freeing one is a no-op and dup/slice copy them into the pool. They never spill on their own
+// (the handle is the caller's storage): a write, recv or reserve past the capacity writes nothing, returns 0/-1 (ENOSPC)/NULL,
+// is counted in inline_overflows and logged once. Move the buffer to the pool (buffer_dup, iobacking_spill) before growing it
+buffer_t * buffer_newinline(void * storage);
+bool buffer_isinline(const buffer_t * buffer);
 buffer_t * buffer_dup(const buffer_t * src);
+// A reference shares the handle itself (one refcount increment, no pages touched). Nobody may write to a
+// referenced buffer until the other holders have freed theirs, use buffer_dup for a writable copy
+buffer_t * buffer_ref(const buffer_t * buffer);
+bool buffer_isshared(const buffer_t * buffer);
+buffer_t * buffer_slice(const buffer_t * src, off_t offset, size_t length);
 
 size_t buffer_write(buffer_t * buffer, const void * data, off_t offset, size_t length);
 size_t buffer_read(const buffer_t * buffer, void * data, off_t offset, size_t length);
 ssize_t buffer_send(const buffer_t * buffer, int fd, off_t offset, size_t length);
+ssize_t buffer_recv(buffer_t * buffer, int fd, off_t offset, size_t length);
+ssize_t buffer_recvfile(buffer_t * buffer, int fd, off_t offset, off_t fileoffset, size_t length);
 
 size_t buffer_size(const buffer_t * buffer);
 void buffer_free(buffer_t * buffer);
@@ -37,8 +87,16 @@ void bufferpos_new(bufferpos_t * pos, buffer_t * buffer, size_t offset);
 bool bufferpos_write(bufferpos_t * pos, const void * data, size_t length);
 size_t bufferpos_read(bufferpos_t * pos, void * data, size_t length);
 ssize_t bufferpos_send(bufferpos_t * pos, int fd, size_t length);
+ssize_t bufferpos_recv(bufferpos_t * pos, int fd, size_t length);
 size_t bufferpos_remaining(const bufferpos_t * pos);
 off_t bufferpos_seek(bufferpos_t * pos, off_t offset, int whence);
+
+// Write/read in place: reserve returns length writable bytes at pos (NULL if they would span pages), commit
+// marks length of them as written and advances pos. Peek returns length readable bytes at pos (NULL if they span pages)
+void * buffer_reserve(bufferpos_t * pos, size_t length);
+void buffer_commit(bufferpos_t * pos, size_t length);
+const void * buffer_peek(const bufferpos_t * pos, size_t length);
+size_t bufferpos_span(const bufferpos_t * pos);		// Bytes at pos that can be reserved/peeked as one span
 #define bufferpos_clear(b)	({ (b)->buffer = NULL; (b)->offset = 0; })
 
 #ifdef __cplusplus
@@ -0,0 +1,92 @@
+#include <stdio.h>
+#include <string.h>
+
+#include <aul/common.h>
+
+#include <histogram.h>
+
+
+static inline size_t bucketindex(uint64_t nanos)
+{
+	if (nanos < (2 * HISTOGRAM_SUBBUCKETS))
+	{
+		// The first two powers of two are exact
+		return nanos;
+	}
+
+	size_t exponent = 63 - __builtin_clzll(nanos);
+	if unlikely(exponent >= HISTOGRAM_MAXBITS)
+	{
+		return HISTOGRAM_BUCKETS - 1;
+	}
+
+	return (exponent - HISTOGRAM_SUBBITS + 1) * HISTOGRAM_SUBBUCKETS + ((nanos >> (exponent - HISTOGRAM_SUBBITS)) & (HISTOGRAM_SUBBUCKETS - 1));
+}
+
+static inline uint64_t bucketlimit(size_t index)
+{
+	// Highest value that lands in the given bucket
+	if (index < (2 * HISTOGRAM_SUBBUCKETS))
+	{
+		return index;
+	}
+
+	size_t shift = index / HISTOGRAM_SUBBUCKETS - 1;
+	uint64_t low = (uint64_t)(HISTOGRAM_SUBBUCKETS + index % HISTOGRAM_SUBBUCKETS) << shift;
+	return low + ((uint64_t)1 << shift) - 1;
+}
+
+void histogram_clear(histogram_t * histogram)
+{
+	memset(histogram, 0, sizeof(histogram_t));
+}
+
+void histogram_record(histogram_t * histogram, uint64_t nanos)
+{
+	if (histogram->count == 0 || nanos < histogram->min)
+	{
+		histogram->min = nanos;
+	}
+
+	if (nanos > histogram->max)
+	{
+		histogram->max = nanos;
+	}
+
+	histogram->buckets[bucketindex(nanos)] += 1;
+	histogram->sum += nanos;
+	histogram->count += 1;
+}
+
+uint64_t histogram_percentile(const histogram_t * histogram, double percentile)
+{
+	uint64_t count = histogram->count;
+	if (count == 0)
+	{
+		return 0;
+	}
+
+	uint64_t rank = (uint64_t)((min(percentile, 100.0) / 100.0) * (double)count + 0.5);
+	rank = max(rank, (uint64_t)1);
+
+	uint64_t seen = 0;
+	for (size_t i = 0; i < HISTOGRAM_BUCKETS; i++)
+	{
+		seen += histogram->buckets[i];
+		if (seen >= rank)
+		{
+			// The last bucket has no upper limit, the max is the best answer there
+			return (i == HISTOGRAM_BUCKETS - 1)? histogram->max : min(bucketlimit(i), histogram->max);
+		}
+	}
+
+	return histogram->max;
+}
+
+ssize_t histogram_desc(const histogram_t * histogram, char * buffer, size_t length)
+{
+	uint64_t count = histogram->count;
+	uint64_t mean = (count == 0)? 0 : histogram->sum / count;
+
+	return snprintf(buffer, length, "{ 'count': %" PRIu64 ", 'min': %" PRIu64 ", 'mean': %" PRIu64 ", 'p50': %" PRIu64 ", 'p99': %" PRIu64 ", 'p999': %" PRIu64 ", 'max': %" PRIu64 " }", count, histogram->min, mean, histogram_percentile(histogram, 50.0), histogram_percentile(histogram, 99.0), histogram_percentile(histogram, 99.9), histogram->max);
+}
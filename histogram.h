@@ -0,0 +1,38 @@
+#ifndef __HISTOGRAM_H
+#define __HISTOGRAM_H
+
+#include <aul/common.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Log-linear (HDR style) histogram of nanosecond values. Every power of two is split into HISTOGRAM_SUBBUCKETS
+// linear buckets, so a recorded value is known to within 1 / HISTOGRAM_SUBBUCKETS (~6%) at any magnitude
+#define HISTOGRAM_SUBBITS		4
+#define HISTOGRAM_SUBBUCKETS	(1 << HISTOGRAM_SUBBITS)
+#define HISTOGRAM_MAXBITS		32		// Values past 2^32 ns (~4.3 seconds) are counted in the last bucket
+#define HISTOGRAM_BUCKETS		((HISTOGRAM_MAXBITS - HISTOGRAM_SUBBITS + 1) * HISTOGRAM_SUBBUCKETS)
+
+// A histogram has a single writer. Readers on other threads get an approximate (but never invalid) snapshot
+typedef struct
+{
+	uint64_t count;
+	uint64_t sum;
+	uint64_t min;
+	uint64_t max;
+	uint64_t buckets[HISTOGRAM_BUCKETS];
+} histogram_t;
+
+void histogram_clear(histogram_t * histogram);
+void histogram_record(histogram_t * histogram, uint64_t nanos);
+uint64_t histogram_percentile(const histogram_t * histogram, double percentile);		// Percentile is 0.0 - 100.0
+#define histogram_count(h)		((h)->count)
+#define histogram_max(h)		((h)->max)
+
+ssize_t histogram_desc(const histogram_t * histogram, char * buffer, size_t length);		// JSON summary (count, min, mean, p50, p99, p99.9, max)
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -8,7 +8,7 @@
 #include <kernel.h>
 #include <kernel-priv.h>
 
-static size_t iobacking_size(char sig)
+ssize_t iobacking_size(char sig)
 {
 	switch (sig)
 	{
@@ -20,7 +20,7 @@ static size_t iobacking_size(char sig)
 		case T_STRING:			return sizeof(char *) + sizeof(char) * AUL_STRING_MAXLEN;
 		case T_ARRAY_BOOLEAN:
 		case T_ARRAY_INTEGER:
-		case T_ARRAY_DOUBLE:	return sizeof(array_t *);
+		case T_ARRAY_DOUBLE:	return sizeof(array_t *) + BUFFER_INLINESIZE;
 		case T_BUFFER:			return sizeof(buffer_t *);
 		default:				return -1;
 	}
@@ -53,13 +53,23 @@ iobacking_t * iobacking_new(char sig, exception_t ** err)
 	// Handle type-specific initialization
 	switch (sig)
 	{
+		case T_ARRAY_BOOLEAN:
+		case T_ARRAY_INTEGER:
+		case T_ARRAY_DOUBLE:
+		{
+			// Arrays look like this:
+			//  [  array_t *  |   inline storage...   ]
+			// The array pointer refers to the inline storage while the array is small (see iobacking_copyarray)
+			break;
+		}
+
 		case T_STRING:
 		{
 			// Set up the buffer so that it looks like this:
 			//  [  char *  |   string...      ]
 			// First member points to the rest of the string
 			//   we use this so that when we return the data chunk pointer, its of type pointer to char *
-			char ** head = (char **)&backing[0];
+			char ** head = (char **)&backing->data[0];
 			*head = (char *)&backing->data[sizeof(char *)];
 			break;
 		}
@@ -84,6 +94,119 @@ void iobacking_destroy(iobacking_t * backing)
 	free(backing);
 }
 
+void iobacking_copyarray(void * to, bool to_isnull, const array_t * from, bool share)
+{
+	array_t ** array = (array_t **)to;
+
+	if (from != NULL && buffer_size(from) <= BUFFER_INLINECAPACITY)
+	{
+		// Small enough to live inline, copy it straight into the backing
+		if (!to_isnull && !buffer_isinline(*array))
+		{
+			buffer_free(*array);
+		}
+
+		size_t size = buffer_size(from);
+		bufferpos_t pos;
+		bufferpos_new(&pos, buffer_newinline(iobacking_inline(to)), 0);
+		buffer_read(from, buffer_reserve(&pos, size), 0, size);
+		buffer_commit(&pos, size);
+
+		*array = pos.buffer;
+		return;
+	}
+
+	array_t * dup = NULL;
+	if (from != NULL && (dup = (share)? buffer_ref(from) : buffer_dup(from)) == NULL)
+	{
+		// Out of buffer memory (counted by the pool), keep the previous value rather than dropping it
+		return;
+	}
+
+	if (!to_isnull && !buffer_isinline(*array))
+	{
+		buffer_free(*array);
+	}
+
+	*array = dup;
+}
+
+array_t * iobacking_spill(void * to)
+{
+	// Move an inline array out to the pool so that it can grow past the inline storage
+	array_t ** array = (array_t **)to;
+	if (!buffer_isinline(*array))
+	{
+		return *array;
+	}
+
+	array_t * spilled = buffer_dup(*array);
+	if (spilled != NULL)
+	{
+		*array = spilled;
+	}
+
+	return spilled;
+}
+
+array_t * iobacking_unshare(void * to)
+{
+	// Take a private copy of an array that arrived by reference so that it can be written in place
+	array_t ** array = (array_t **)to;
+	if (!buffer_isshared(*array))
+	{
+		return *array;
+	}
+
+	array_t * private = buffer_dup(*array);
+	if (private != NULL)
+	{
+		buffer_free(*array);
+		*array = private;
+	}
+
+	return private;
+}
+
+void iobacking_convertarray(void * to, bool to_isnull, const array_t * from, char fromtype, char totype)
+{
+	array_t ** array = (array_t **)to;
+
+	if (from == NULL)
+	{
+		iobacking_copyarray(to, to_isnull, NULL, false);
+		return;
+	}
+
+	if (array_size(from, fromtype) * array_typesize(totype) <= BUFFER_INLINECAPACITY)
+	{
+		// Converted array fits inline, convert straight into the backing
+		if (!to_isnull && !buffer_isinline(*array))
+		{
+			buffer_free(*array);
+		}
+
+		*array = buffer_newinline(iobacking_inline(to));
+		array_convertinto(*array, totype, from, fromtype);
+		return;
+	}
+
+	array_t * converted = array_new();
+	if (converted == NULL || !array_convertinto(converted, totype, from, fromtype))
+	{
+		// Out of buffer memory (counted by the pool), keep the previous value rather than dropping it
+		array_free(converted);
+		return;
+	}
+
+	if (!to_isnull && !buffer_isinline(*array))
+	{
+		buffer_free(*array);
+	}
+
+	*array = converted;
+}
+
 void iobacking_copy(iobacking_t * backing, const void * data)
 {
 	// Sanity check
@@ -141,22 +264,30 @@ void iobacking_copy(iobacking_t * backing, const void * data)
 		case T_ARRAY_BOOLEAN:
 		case T_ARRAY_INTEGER:
 		case T_ARRAY_DOUBLE:
+		{
+			const array_t * const * from = (const array_t * const *)data;
+			iobacking_copyarray(iobacking_data(backing), iobacking_isnull(backing), (from == NULL)? NULL : *from, false);
+			break;
+		}
+
 		case T_BUFFER:
 		{
 			const buffer_t ** from = (const buffer_t **)data;
 			buffer_t ** to = (buffer_t **)iobacking_data(backing);
 
-			if (!iobacking_isnull(backing))
+			buffer_t * dup = NULL;
+			if (from != NULL && (dup = buffer_dup(*from)) == NULL && *from != NULL)
 			{
-				buffer_free(*to);
-				*to = NULL;
+				// Out of buffer memory (counted by the pool), keep the previous value rather than dropping it
+				return;
 			}
 
-			if (from != NULL)
+			if (!iobacking_isnull(backing))
 			{
-				*to = buffer_dup(*from);
+				buffer_free(*to);
 			}
 
+			*to = dup;
 			break;
 		}
 
@@ -170,4 +301,5 @@ void iobacking_copy(iobacking_t * backing, const void * data)
 	}
 
 	iobacking_isnull(backing) = (data == NULL);
+	iobacking_generation(backing) += 1;
 }
@@ -14,6 +14,8 @@
 #include <maxmodel/meta.h>
 #include <maxmodel/model.h>
 
+#include <array.h>
+#include <histogram.h>
 #include <kernel.h>
 
 #ifdef __cplusplus
@@ -27,7 +29,14 @@ extern "C" {
 #endif
 
 
-#define BUFFER_POOL_SIZE		(20 * 1024 * 1024)		// 20 MB
+#define BUFFER_POOL_SIZE		(20 * 1024 * 1024)		// 20 MB initially
+#define BUFFER_POOL_MAXSIZE		(512 * 1024 * 1024)		// 512 MB
+#define BUFFER_POOL_LOWWATER	(4 * 1024 * 1024)		// Grow the pool when less than 4 MB is free
+#define BUFFER_POOL_HIGHWATER	(64 * 1024 * 1024)		// Give memory back when more than 64 MB is free
+#define BUFFER_POOL_FLAGS		BUFFER_HUGEPAGES
+#define BUFFER_POOL_WAIT		10						// Non-realtime threads wait up to 10 ms for pages when the pool is exhausted
+#define BUFFER_POOL_RESERVE		1024					// 1 MB (in KB) of pages held back for realtime rategroups
+#define BUFFER_TASK_PERIOD		NANOS_PER_SECOND
 #define CAL_SIZE_CACHE			AUL_STRING_MAXLEN
 #define CONFIG_SIZE_CACHE		MODEL_SIZE_VALUE
 
@@ -40,14 +49,25 @@ extern "C" {
 #define SCHED_POLICY			SCHED_RR
 #define SCHED_PRIO_BASE			5
 
+#define DEADLINE_WARMUP			200						// Updates measured on SCHED_RR before a deadline rategroup asks for admission
+#define DEADLINE_PERCENTILE		99.9					// Measured update time the runtime budget is sized from
+#define DEADLINE_MARGIN			1.5						// Runtime budget over the DEADLINE_PERCENTILE update
+#define DEADLINE_MINRUNTIME		10000					// 10 microseconds
+
 #define KTHREAD_TASK_PERIOD		NANOS_PER_SECOND
 
+#define LINK_READRETRIES		8						// Seqlock read attempts before a link keeps its previous value
+
 
 typedef struct __block_t block_t;
 typedef struct __blockinst_t blockinst_t;
 typedef struct __trigger_t trigger_t;
 typedef struct __kthread_t kthread_t;
 typedef struct __iobacking_t iobacking_t;
+typedef struct __linkbatch_t linkbatch_t;
+typedef struct __linkplan_t linkplan_t;
+typedef struct __linksync_t linksync_t;
+typedef struct __rategroupteam_t rategroupteam_t;
 
 typedef void (*blind_f)();
 typedef void (*closure_f)(void * ret, const void * args[], void * userdata);
@@ -204,9 +224,17 @@ struct __trigger_t
 typedef struct
 {
 	trigger_t trigger;
-	struct timespec last_trigger;
+	struct timespec deadline;		// Next absolute (CLOCK_MONOTONIC) deadline, zero until the first trigger
+	uint64_t scheduled_nsec;		// Deadline (CLOCK_MONOTONIC nanoseconds) of the most recent trigger
+	uint64_t runtime_nsec;			// Non-zero once the thread runs under SCHED_DEADLINE, which then releases every period
+	bool refused;					// SCHED_DEADLINE was refused (or dropped on a rate change), the thread stays on SCHED_RR
 	uint64_t interval_nsec;
 	double freq_hz;
+
+	model_overrun_t overrun;
+	bool overrunning;
+	uint64_t overruns;				// Deadlines that were already past when the previous period finished
+	uint64_t skipped;				// Periods dropped to get back on schedule
 } trigger_clock_t;
 
 typedef struct
@@ -253,7 +281,9 @@ struct __iobacking_t
 {
 	char sig;
 	bool isnull;
-	uint8_t data[0];
+	volatile uint32_t seq;			// Odd while the writer of a link's intermediate backing is updating it
+	uint32_t generation;			// Bumped on every write, links skip the copy when it hasn't moved
+	uint8_t data[0] __attribute__((aligned(8)));
 };
 
 typedef struct
@@ -264,17 +294,38 @@ typedef struct
 	iobacking_t * backing;
 	link_f linkfunction;
 	void * linkdata;
+	linkbatch_t * batch;			// Run of indexed links into/out of one array, compiled by link_sort (set on the first link of the run)
+	uint32_t generation;			// Generation of the source backing at the last copy
+	linksync_t * sync;				// Triple buffer shared by both ends (arrays, buffers and links routed as triplebuffer), NULL when the backing's seqlock is used
 } link_t;
 
+typedef struct
+{
+	hashentry_t global_entry;
+	char name[MODEL_SIZE_NAME];
+	size_t slot;					// Handed out in intern order, indexes a portindex_t
+	volatile bool warned;			// A lookup by this name found no port (warned once, see rategroup_missingport)
+} portkey_t;
+
 typedef struct
 {
 	list_t port_list;
 
 	meta_iotype_t type;
 	char name[MODEL_SIZE_NAME];
+	const portkey_t * key;			// Interned name, its slot finds the port in a portindex_t
 	iobacking_t * backing;
+	uint32_t seen;					// Backing generation when the block last finished an update (see port_markseen)
 } port_t;
 
+typedef struct
+{
+	// Ports of one type by key slot, so a handle resolves with one indexed load (see port_lookupindex)
+	size_t base;					// Lowest key slot of the ports
+	size_t length;
+	port_t ** ports;				// NULL where no port has the slot
+} portindex_t;
+
 
 
 typedef struct
@@ -283,6 +334,21 @@ typedef struct
 
 	blockinst_t * blockinst;
 	portlist_t ports;
+	portindex_t inputs_index;			// The ports by key slot, for the input()/output() handles
+	portindex_t outputs_index;
+
+	// Compiled by rategroup_schedule once all the links are built
+	blockact_f onupdate;
+	linkplan_t * inputs;
+	linkplan_t * outputs;
+
+	histogram_t execution;				// Links and onupdate, in nanoseconds
+
+	// Dependencies on the other block instances, built by rategroup_schedule when the rategroup has workers
+	size_t * next;						// Plan indexes of the block instances that wait for this one
+	size_t next_length;
+	size_t waitfor;						// Number of block instances this one waits for
+	size_t pending;						// Of those, the ones that haven't finished the current update (under the team mutex)
 } rategroup_blockinst_t;
 
 typedef struct
@@ -292,10 +358,20 @@ typedef struct
 
 	char * name;
 	int priority;
+	char * cpus;						// CPU list the rategroup thread is pinned to, NULL if it isn't
+	model_schedmode_t sched;			// Switched back to model_schedroundrobin if SCHED_DEADLINE admission fails
 	trigger_varclock_t * trigger;
 
 	list_t blockinsts;
-	rategroup_blockinst_t * active;
+	rategroup_blockinst_t ** plan;		// Flat copy of blockinsts in run order, built by rategroup_schedule
+	size_t plan_length;
+	size_t workers;						// Threads besides the rategroup thread that run independent block instances
+	rategroupteam_t * team;				// NULL when the plan runs in order on the rategroup thread
+
+	// Timing of every update, in nanoseconds (see rategroup_timing)
+	histogram_t latency;				// Trigger deadline to the start of the update
+	histogram_t execution;
+	histogram_t overrun;				// Execution past the trigger period, only recorded when the update didn't fit
 } rategroup_t;
 
 struct __kthread_t
@@ -310,6 +386,11 @@ struct __kthread_t
 	trigger_t * trigger;
 	kobject_t * object;
 
+	bool pinned;					// Run only on cpus (otherwise see kthread_start for the default)
+	cpu_set_t cpus;
+	bool realtime;					// Thread can't block on an exhausted buffer pool (see buffer_setrealtime)
+	bool deadline;					// Thread runs under SCHED_DEADLINE, its trigger ends each job (see kthread_setdeadline)
+
 	runnable_f runfunction;
 
 	// TODO - rename this destroyfunction (because it is called in all cased of threaddeath)
@@ -325,6 +406,13 @@ typedef struct
 	void * userdata;
 } kthreaddata_t;
 
+typedef struct
+{
+	list_t affinity_list;
+	char * name;					// Thread name, set from the configuration script (see cfg_affinity)
+	cpu_set_t cpus;
+} kthreadaffinity_t;
+
 
 typedef enum
 {
@@ -365,6 +453,11 @@ syscallblock_t * syscallblock_new(const model_linkable_t * linkable, exception_t
 kthread_t * kthread_new(const char * name, int priority, trigger_t * trigger, kobject_t * object, runnable_f runfunction, runnable_f stopfunction, exception_t ** err);
 void kthread_schedule(kthread_t * thread);
 kthread_t * kthread_self();
+bool kthread_pin(kthread_t * thread, const char * cpus, exception_t ** err);
+bool kthread_setdeadline(uint64_t runtime_nsec, uint64_t period_nsec, exception_t ** err);		// Calling thread only
+void kthread_setroundrobin(int priority);
+bool kthread_parsecpus(const char * str, cpu_set_t * cpus, exception_t ** err);
+string_t kthread_cpustring(const cpu_set_t * cpus);
 #define kthread_trigger(kth)	((kth)->trigger)
 #define kthread_object(kth)		((kth)->object)
 
@@ -372,7 +465,10 @@ void * trigger_new(const char * name, desc_f info, destructor_f destructor, trig
 bool trigger_watch(trigger_t * trigger);
 trigger_clock_t * trigger_newclock(const char * name, double freq_hz);
 trigger_varclock_t * trigger_newvarclock(const char * name, double initial_freq_hz, exception_t ** err);
+void trigger_setoverrun(trigger_clock_t * clk, model_overrun_t overrun);
+bool trigger_setdeadline(trigger_clock_t * clk, uint64_t runtime_nsec, exception_t ** err);
 #define trigger_cast(t)			((trigger_t *)(t))
+#define trigger_varclock_clock(t)	(&(t)->clock)
 #define trigger_varclock_links(t)	(&(t)->links)
 #define trigger_varclock_ports(t)	(&(t)->ports)
 
@@ -405,17 +501,27 @@ void blockinst_act(blockinst_t * blockinst, blockact_f callback);
 iobacking_t * iobacking_new(char sig, exception_t ** err);
 void iobacking_destroy(iobacking_t * backing);
 void iobacking_copy(iobacking_t * backing, const void * data);
+ssize_t iobacking_size(char sig);
 #define iobacking_sig(backing)	((backing)->sig)
 #define iobacking_isnull(backing)	((backing)->isnull)
+#define iobacking_generation(backing)	((backing)->generation)
 #define iobacking_data(backing)	((void *)(backing)->data)
+#define iobacking_inline(data)	((void *)((array_t **)(data) + 1))		// Inline storage behind an array port's pointer
+void iobacking_copyarray(void * to, bool to_isnull, const array_t * from, bool share);		// Share takes a reference (read only) instead of a copy
+array_t * iobacking_spill(void * to);
+array_t * iobacking_unshare(void * to);
+void iobacking_convertarray(void * to, bool to_isnull, const array_t * from, char fromtype, char totype);
 
 #define linklist_init(l)		({ list_init(&(l)->inputs); list_init(&(l)->outputs); })
 iobacking_t * link_connect(const model_link_t * link, char outsig, linklist_t * outlinks, char insig, linklist_t * inlinks, exception_t ** err);
 void link_destroy(linklist_t * links);
 link_f link_getfunction(const model_linksymbol_t * model_link, char from_sig, char to_sig, void ** linkdata);
+bool link_isconnected(const linklist_t * outlinks, const linklist_t * inlinks);
 void link_doinputs(portlist_t * ports, linklist_t * links);
 void link_dooutputs(portlist_t * ports, linklist_t * links);
 void link_sort(linklist_t * links);
+linkplan_t * link_compile(portlist_t * ports, linklist_t * links, meta_iotype_t type, exception_t ** err);
+void link_runplan(const linkplan_t * plan);
 #define link_symbol(link)		((link)->symbol)
 
 #define portlist_init(l)		({ list_init(l); })
@@ -423,12 +529,20 @@ void link_sort(linklist_t * links);
 bool port_add(portlist_t * ports, meta_iotype_t type, const char * name, iobacking_t * backing, exception_t ** err);
 void port_destroy(portlist_t * ports);
 port_t * port_lookup(portlist_t * ports, meta_iotype_t type, const char * name);
+const portkey_t * port_intern(const char * name);
+bool port_makeindex(portlist_t * ports, meta_iotype_t type, portindex_t * index, exception_t ** err);
+void port_destroyindex(portindex_t * index);
+#define port_lookupindex(index, handle)	({ const portindex_t * __index = (index); size_t __slot = ((const portkey_t *)(handle))->slot - __index->base; (__slot < __index->length)? __index->ports[__slot] : NULL; })
+void port_markseen(portlist_t * ports);
+#define port_changed(port)		((port)->backing->generation != (port)->seen)
 bool port_makeblockports(const block_t * block, portlist_t * list, exception_t ** err);
 #define port_iobacking(port)	((port)->backing)
 
 rategroup_t * rategroup_new(const model_linkable_t * linkable, exception_t ** err);
 bool rategroup_addblockinst(rategroup_t * rategroup, blockinst_t * blockinst, exception_t ** err);
 bool rategroup_schedule(rategroup_t * rategroup, exception_t ** err);
+const char * rategroup_timing(const char * name);
+const char * rategroup_blockinsttiming(const char * name, const char * blockinst_name);
 #define rategroup_name(rg)		((rg)->name)
 #define rategroup_links(rg)		(trigger_varclock_links((rg)->trigger))
 #define rategroup_ports(rg)		(trigger_varclock_ports((rg)->trigger))
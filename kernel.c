@@ -9,6 +9,7 @@
 #include <malloc.h>
 #include <dirent.h>
 #include <sys/mman.h>
+#include <sys/syscall.h>
 #include <sys/time.h>
 #include <sys/types.h>
 #include <pthread.h>
@@ -41,10 +42,11 @@ list_t rategroups;
 //list_t calentries;
 hashtable_t properties;
 hashtable_t syscalls;
+hashtable_t portkeys;
+mutex_t portkeys_mutex;
 list_t kthreads;
 
 mainloop_t * mainloop = NULL;
-mutex_t io_lock;
 sqlite3 * database = NULL;
 calibration_t calibration;
 uint64_t starttime = 0;
@@ -55,7 +57,12 @@ static list_t kobjects = {0,0};
 static mutex_t kobj_mutex;
 
 static mutex_t kthreads_mutex;
+static list_t kthreads_affinities;		// Per-thread CPU lists from the configuration script
+static bool kthreads_hashousekeeping = false;
+static cpu_set_t kthreads_housekeeping;	// CPUs for the mainloop and the non-realtime threads
+static cpu_set_t kthreads_anycpu;		// CPUs the kernel was started on (for threads that aren't pinned)
 static timerwatcher_t kthreads_timer;
+static timerwatcher_t buffer_timer;
 
 static char logbuf[LOGBUF_SIZE] = {0};
 static size_t loglen = 0;
@@ -364,7 +371,13 @@ static ssize_t kthread_desc(const kobject_t * object, char * buffer, size_t leng
 	{
 		string_set(&trigger_id, "%#x", kobj_id(kobj_cast(kth->trigger)));
 	}
-	return snprintf(buffer, length, "{ 'running': %s, 'stop_flag': %s, 'priority': %d, 'trigger_id': '%s' }", ser_bool(&kth->running), ser_bool(&kth->stop), kth->priority, trigger_id.string);
+	string_t cpus = string_new("any");
+	if (kth->pinned)
+	{
+		cpus = kthread_cpustring(&kth->cpus);
+	}
+
+	return snprintf(buffer, length, "{ 'running': %s, 'stop_flag': %s, 'priority': %d, 'trigger_id': '%s', 'cpus': '%s' }", ser_bool(&kth->running), ser_bool(&kth->stop), kth->priority, trigger_id.string, cpus.string);
 }
 
 static void kthread_destroy(kobject_t * object)
@@ -396,6 +409,7 @@ static void * kthread_dothread(void * object)
 {
 	kthread_t * kth = object;
 	kthread_local = kth;
+	buffer_setrealtime(kth->realtime);
 
 	kth->running = true;
 	kth->stop = false;
@@ -413,8 +427,12 @@ static void * kthread_dothread(void * object)
 				break;
 			}
 
-			// Yield before the next round
-			pthread_yield();
+			// Yield before the next round. A SCHED_DEADLINE thread must not, a yield throttles it until the next period
+			// and its trigger already gives back the rest of each one (a second yield would skip every other period)
+			if (!kth->deadline)
+			{
+				pthread_yield();
+			}
 		}
 	}
 
@@ -424,24 +442,73 @@ static void * kthread_dothread(void * object)
 
 static bool kthread_start(kthread_t * kth)
 {
-	pthread_attr_t attr;
-	memset(&attr, 0, sizeof(pthread_attr_t));
-	pthread_attr_init(&attr);
+	// Pick the CPUs, the configuration script has the final say, then the thread itself
+	// Threads without a trigger aren't periodic (service dispatch, streams, etc), they go on the housekeeping CPUs
+	{
+		list_t * pos = NULL;
+		list_foreach(pos, &kthreads_affinities)
+		{
+			kthreadaffinity_t * affinity = list_entry(pos, kthreadaffinity_t, affinity_list);
+			if (strcmp(affinity->name, kobj_objectname(kobj_cast(kth))) == 0)
+			{
+				kth->pinned = true;
+				kth->cpus = affinity->cpus;
+			}
+		}
+
+		if (!kth->pinned && kth->trigger == NULL && kthreads_hashousekeeping)
+		{
+			kth->pinned = true;
+			kth->cpus = kthreads_housekeeping;
+		}
+	}
 
-	// Set up the attr
+	int result = 0;
+	bool create(const cpu_set_t * cpus)
 	{
-		struct sched_param param;
-		memset(&param, 0, sizeof(struct sched_param));
-		param.sched_priority = SCHED_PRIO_BASE + kth->priority;
+		pthread_attr_t attr;
+		memset(&attr, 0, sizeof(pthread_attr_t));
+		pthread_attr_init(&attr);
 
-		pthread_attr_setschedpolicy(&attr, SCHED_POLICY);
-		pthread_attr_setschedparam(&attr, &param);
-		pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
+		// Set up the attr
+		{
+			struct sched_param param;
+			memset(&param, 0, sizeof(struct sched_param));
+			param.sched_priority = SCHED_PRIO_BASE + kth->priority;
+
+			pthread_attr_setschedpolicy(&attr, SCHED_POLICY);
+			pthread_attr_setschedparam(&attr, &param);
+			pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
+
+			if (cpus != NULL && (result = pthread_attr_setaffinity_np(&attr, sizeof(cpu_set_t), cpus)) != 0)
+			{
+				pthread_attr_destroy(&attr);
+				return false;
+			}
+		}
+
+		result = pthread_create(&kth->thread, &attr, kthread_dothread, kth);
+		pthread_attr_destroy(&attr);
+		return result == 0;
 	}
 
-	if (pthread_create(&kth->thread, &attr, kthread_dothread, kth) != 0)
+	// Threads otherwise inherit the mainloop's CPUs, which are only the housekeeping ones when those are set
+	const cpu_set_t * anycpu = (kthreads_hashousekeeping)? &kthreads_anycpu : NULL;
+
+	bool created = create((kth->pinned)? &kth->cpus : anycpu);
+	if (!created && kth->pinned && result == EINVAL)
 	{
-		LOGK(LOG_FATAL, "Could not create new thread: %s", strerror(errno));
+		// The CPUs might be offline or outside our cpuset (EINVAL), better to run anywhere than not at all
+		// Anything else (no resources, no permission for the policy) would fail unpinned just the same
+		LOGK(LOG_WARN, "Could not pin thread %s to CPUs %s: %s", kobj_objectname(kobj_cast(kth)), kthread_cpustring(&kth->cpus).string, strerror(result));
+
+		kth->pinned = false;
+		created = create(anycpu);
+	}
+
+	if (!created)
+	{
+		LOGK(LOG_FATAL, "Could not create new thread: %s", strerror(result));
 		return false;
 	}
 
@@ -475,6 +542,8 @@ kthread_t * kthread_new(const char * name, int priority, trigger_t * trigger, ko
 
 	kthread_t * kth = kobj_new("Thread", name, kthread_desc, kthread_destroy, sizeof(kthread_t));
 	kth->priority = priority;
+	kth->realtime = false;
+	kth->deadline = false;
 	kth->running = false;
 	kth->stop = false;
 	kth->trigger = trigger;
@@ -492,6 +561,205 @@ kthread_t * kthread_self()
 	return kthread_local;
 }
 
+bool kthread_pin(kthread_t * thread, const char * cpus, exception_t ** err)
+{
+	// Sanity check
+	{
+		if unlikely(exception_check(err))
+		{
+			return false;
+		}
+
+		if unlikely(thread == NULL || cpus == NULL)
+		{
+			exception_set(err, EINVAL, "Bad arguments!");
+			return false;
+		}
+	}
+
+	if (!kthread_parsecpus(cpus, &thread->cpus, err))
+	{
+		return false;
+	}
+
+	thread->pinned = true;
+	return true;
+}
+
+bool kthread_setdeadline(uint64_t runtime_nsec, uint64_t period_nsec, exception_t ** err)
+{
+	// Sanity check
+	{
+		if unlikely(exception_check(err))
+		{
+			return false;
+		}
+
+		if unlikely(runtime_nsec == 0 || runtime_nsec > period_nsec)
+		{
+			exception_set(err, EINVAL, "Bad arguments!");
+			return false;
+		}
+	}
+
+#if defined(SYS_sched_setattr) && defined(SCHED_DEADLINE)
+	// glibc doesn't wrap sched_setattr, this is the kernel's struct sched_attr
+	struct
+	{
+		uint32_t size;
+		uint32_t sched_policy;
+		uint64_t sched_flags;
+		int32_t sched_nice;
+		uint32_t sched_priority;
+		uint64_t sched_runtime;
+		uint64_t sched_deadline;
+		uint64_t sched_period;
+	} attr;
+
+	memset(&attr, 0, sizeof(attr));
+	attr.size = sizeof(attr);
+	attr.sched_policy = SCHED_DEADLINE;
+	attr.sched_runtime = runtime_nsec;
+	attr.sched_deadline = period_nsec;
+	attr.sched_period = period_nsec;
+
+	if (syscall(SYS_sched_setattr, 0, &attr, 0) != 0)
+	{
+		// EBUSY when admission control says no, EPERM when pinned to part of the root domain
+		exception_set(err, errno, "sched_setattr failed: %s", strerror(errno));
+		return false;
+	}
+
+	if (kthread_self() != NULL)
+	{
+		kthread_self()->deadline = true;
+	}
+
+	return true;
+#else
+	exception_set(err, ENOSYS, "SCHED_DEADLINE isn't supported by this build");
+	return false;
+#endif
+}
+
+void kthread_setroundrobin(int priority)
+{
+	struct sched_param param;
+	memset(&param, 0, sizeof(struct sched_param));
+	param.sched_priority = SCHED_PRIO_BASE + priority;
+
+	int result = pthread_setschedparam(pthread_self(), SCHED_POLICY, &param);
+	if (result != 0)
+	{
+		LOGK(LOG_WARN, "Could not set scheduler settings: %s", strerror(result));
+		return;
+	}
+
+	if (kthread_self() != NULL)
+	{
+		kthread_self()->deadline = false;
+	}
+}
+
+bool kthread_parsecpus(const char * str, cpu_set_t * cpus, exception_t ** err)
+{
+	// Sanity check
+	{
+		if unlikely(exception_check(err))
+		{
+			return false;
+		}
+
+		if unlikely(str == NULL || cpus == NULL)
+		{
+			exception_set(err, EINVAL, "Bad arguments!");
+			return false;
+		}
+	}
+
+	// Parse a list like '0-3,6'
+	long configured = sysconf(_SC_NPROCESSORS_CONF);
+	CPU_ZERO(cpus);
+
+	const char * next = str;
+	while (*next != '\0')
+	{
+		char * end = NULL;
+		long first = strtol(next, &end, 10), last = first;
+		if (end == next || first < 0)
+		{
+			exception_set(err, EINVAL, "Bad CPU list '%s'", str);
+			return false;
+		}
+
+		if (*end == '-')
+		{
+			next = end + 1;
+			last = strtol(next, &end, 10);
+			if (end == next || last < first)
+			{
+				exception_set(err, EINVAL, "Bad CPU range in list '%s'", str);
+				return false;
+			}
+		}
+
+		if (last >= configured || last >= CPU_SETSIZE)
+		{
+			exception_set(err, EINVAL, "CPU %ld in list '%s' doesn't exist (%ld CPUs)", last, str, configured);
+			return false;
+		}
+
+		for (long cpu = first; cpu <= last; cpu++)
+		{
+			CPU_SET(cpu, cpus);
+		}
+
+		if (*end == ',')
+		{
+			end += 1;
+		}
+		else if (*end != '\0')
+		{
+			exception_set(err, EINVAL, "Bad CPU list '%s'", str);
+			return false;
+		}
+
+		next = end;
+	}
+
+	if (CPU_COUNT(cpus) == 0)
+	{
+		exception_set(err, EINVAL, "Empty CPU list");
+		return false;
+	}
+
+	return true;
+}
+
+string_t kthread_cpustring(const cpu_set_t * cpus)
+{
+	// Collapse the set back into a list like '0-3,6'
+	string_t str = string_blank();
+	for (int cpu = 0; cpu < CPU_SETSIZE; cpu++)
+	{
+		if (!CPU_ISSET(cpu, cpus))
+		{
+			continue;
+		}
+
+		int last = cpu;
+		while (last + 1 < CPU_SETSIZE && CPU_ISSET(last + 1, cpus))
+		{
+			last += 1;
+		}
+
+		string_append(&str, (last == cpu)? "%s%d" : "%s%d-%d", (str.length == 0)? "" : ",", cpu, last);
+		cpu = last;
+	}
+
+	return str;
+}
+
 static bool kthread_dotasks(mainloop_t * loop, uint64_t nanoseconds, void * userdata)
 {
 	unused(loop);
@@ -508,7 +776,15 @@ static bool kthread_dotasks(mainloop_t * loop, uint64_t nanoseconds, void * user
 
 			LOGK(LOG_DEBUG, "Starting thread %s", kobj_objectname(kobj_cast(kth)));
 
-			kthread_start(kth);
+			if (kthread_start(kth))
+			{
+				// Report where the thread actually landed (an unpinned thread gets whatever the kernel inherited)
+				cpu_set_t cpus;
+				CPU_ZERO(&cpus);
+				pthread_getaffinity_np(kth->thread, sizeof(cpu_set_t), &cpus);
+
+				LOGK(LOG_INFO, "Thread %s (priority %d) runs on CPUs %s%s", kobj_objectname(kobj_cast(kth)), kth->priority, kthread_cpustring(&cpus).string, (kth->pinned)? "" : " (not pinned)");
+			}
 		}
 	}
 	mutex_unlock(&kthreads_mutex);
@@ -592,6 +868,34 @@ bool kthread_newthread(const char * name, int priority, handler_f threadfunc, ha
 	return true;
 }
 
+// --------------------- Buffer pool functions -----------------------
+static ssize_t bufferpool_desc(const kobject_t * object, char * buffer, size_t length)
+{
+	unused(object);
+
+	bufferstats_t stats;
+	buffer_stats(&stats);
+
+	return snprintf(buffer, length, "{ 'hugepages': %s, 'arenas': %zu, 'arenas_huge': %zu, 'pages_total': %zu, 'pages_free': %zu, 'pages_released': %zu, 'pages_inuse': %zu, 'pages_highwater': %zu, 'alloc_failures': %zu, 'large_extents': %zu, 'large_bytes': %zu, 'pages_reserved': %zu, 'waits': %zu, 'wait_timeouts': %zu, 'reserve_allocs': %zu, 'reclaimed': %zu }", ser_bool(&stats.hugepages), stats.arenas, stats.arenas_huge, stats.pages_total, stats.pages_free, stats.pages_released, stats.pages_inuse, stats.pages_highwater, stats.alloc_failures, stats.large_extents, stats.large_bytes, stats.pages_reserved, stats.waits, stats.wait_timeouts, stats.reserve_allocs, stats.reclaimed);
+}
+
+static bool bufferpool_dotasks(mainloop_t * loop, uint64_t nanoseconds, void * userdata)
+{
+	unused(loop);
+	unused(nanoseconds);
+	unused(userdata);
+
+	buffer_maintain();
+	return true;
+}
+
+static const char * bufferpool_info()
+{
+	static threadlocal char info[SYSCALL_BUFFERMAX];
+	bufferpool_desc(NULL, info, sizeof(info));
+	return info;
+}
+
 // --------------------- Kernel functions -----------------------
 const char * max_model() { return property_get("model"); }
 const char * kernel_id() { return property_get("id"); }
@@ -901,11 +1205,13 @@ int main(int argc, char * argv[])
 	// Set up buffers
 	{
 		exception_t * e = NULL;
-		if (!buffer_init(BUFFER_POOL_SIZE, &e) || exception_check(&e))
+		if (!buffer_init(BUFFER_POOL_SIZE, BUFFER_POOL_MAXSIZE, BUFFER_POOL_FLAGS, &e) || exception_check(&e))
 		{
 			LOGK(LOG_FATAL, "Buffer subsystem initialization failure: %s", exception_message(e));
 			// Will exit
 		}
+
+		buffer_setwatermarks(BUFFER_POOL_LOWWATER, BUFFER_POOL_HIGHWATER);
 	}
 
 	// Initialize global variables
@@ -914,12 +1220,18 @@ int main(int argc, char * argv[])
 	list_init(&rategroups);
 	list_init(&kobjects);
 	list_init(&kthreads);
+	list_init(&kthreads_affinities);
 	hashtable_init(&properties, hash_str, hash_streq);
 	hashtable_init(&syscalls, hash_str, hash_streq);
+	hashtable_init(&portkeys, hash_str, hash_streq);
 	mutex_init(&kobj_mutex, M_RECURSIVE);
 	mutex_init(&kthreads_mutex, M_RECURSIVE);
+	mutex_init(&portkeys_mutex, M_NORMAL);
 	watcher_init(watcher_cast(&kthreads_timer));
-	mutex_init(&io_lock, M_RECURSIVE);
+	watcher_init(watcher_cast(&buffer_timer));
+
+	// Make the buffer pool visible as a kernel object
+	kobj_new("Buffer Pool", "Page pool", bufferpool_desc, NULL, sizeof(kobject_t));
 
 	// Set start time
 	starttime = kernel_timestamp();
@@ -1032,6 +1344,9 @@ int main(int argc, char * argv[])
 	reg_syscall(	property_clear,		"v:s",		"Clears the property name (param 1) and the associated value from the database");
 	reg_syscall(	property_isset,		"b:s",		"Returns true if the property name (param 1) has been set");
 	reg_syscall(    itr_free,			"v:i",		"Frees the given iterator. It can no longer be used after it has been freed");
+	reg_syscall(	bufferpool_info,	"s:v",		"Returns the buffer pool statistics (pages in use, high-water mark, allocation failures, etc.)");
+	reg_syscall(	rategroup_timing,	"s:s",		"Returns the timing summary (nanoseconds) of the given rategroup (param 1): wake-up latency, execution time, overruns and the slowest block instance");
+	reg_syscall(	rategroup_blockinsttiming,	"s:ss",	"Returns the execution time histogram summary (nanoseconds) of the block instance (param 2) in the given rategroup (param 1)");
 
 	// Parse configuration file
 	{
@@ -1197,6 +1512,31 @@ int main(int argc, char * argv[])
 			return 0;
 		}
 
+		int cfg_affinity(cfg_t * cfg, cfg_opt_t * opt, int argc, const char ** argv)
+		{
+			unused(opt);
+
+			if (argc != 2)
+			{
+				cfg_error(cfg, "Invalid argument length for affinity function");
+				return -1;
+			}
+
+			exception_t * e = NULL;
+			kthreadaffinity_t * affinity = malloc(sizeof(kthreadaffinity_t));
+			if (!kthread_parsecpus(argv[1], &affinity->cpus, &e))
+			{
+				cfg_error(cfg, "Could not set affinity of thread %s: %s", argv[0], exception_message(e));
+				exception_free(e);
+				free(affinity);
+				return -1;
+			}
+
+			affinity->name = strdup(argv[0]);
+			list_add(&kthreads_affinities, &affinity->affinity_list);
+			return 0;
+		}
+
 		int cfg_config(cfg_t * cfg, cfg_opt_t * opt, int argc, const char ** argv)
 		{
 			unused(opt);
@@ -1362,6 +1702,9 @@ int main(int argc, char * argv[])
 			CFG_STR(	"path",			INSTALL "/modules",		CFGF_NONE	),
 			CFG_STR(	"installed",	"0",					CFGF_NONE	),
 			CFG_STR(	"model",		"(unknown)",			CFGF_NONE	),
+			CFG_INT(	"buffer_wait",	BUFFER_POOL_WAIT,		CFGF_NONE	),		// Milliseconds
+			CFG_INT(	"buffer_reserve",BUFFER_POOL_RESERVE,	CFGF_NONE	),		// Kilobytes
+			CFG_STR(	"housekeeping_cpus",	"",				CFGF_NONE	),		// CPU list (ex. '0-1'), empty for all
 			CFG_FUNC(	"log",			cfg_loginfo				),
 			CFG_FUNC(	"print",		cfg_loginfo				),
 			CFG_FUNC(	"warn",			cfg_logwarn				),
@@ -1370,6 +1713,7 @@ int main(int argc, char * argv[])
 			CFG_FUNC(	"appendpath",	cfg_appendpath			),
 			CFG_FUNC(	"loadmodule",	cfg_loadmodule			),
 			CFG_FUNC(	"config",		cfg_config				),
+			CFG_FUNC(	"affinity",		cfg_affinity			),
 			CFG_FUNC(	"execfile",		cfg_execfile			),
 			CFG_FUNC(	"execdirectory",cfg_execdir				),
 			CFG_END()
@@ -1411,6 +1755,30 @@ int main(int argc, char * argv[])
 		property_set("installed", cfg_getstr(cfg, "installed"));
 		property_set("model", cfg_getstr(cfg, "model"));
 
+		// Set the buffer pool exhaustion policy
+		buffer_setpolicy((uint64_t)cfg_getint(cfg, "buffer_wait") * (NANOS_PER_SECOND / MILLIS_PER_SECOND), (size_t)cfg_getint(cfg, "buffer_reserve") * 1024);
+
+		// Move the mainloop (and everything it starts without a CPU list) onto the housekeeping CPUs
+		const char * housekeeping = cfg_getstr(cfg, "housekeeping_cpus");
+		if (housekeeping != NULL && strlen(housekeeping) > 0)
+		{
+			exception_t * e = NULL;
+			if (!kthread_parsecpus(housekeeping, &kthreads_housekeeping, &e))
+			{
+				LOGK(LOG_ERR, "Bad housekeeping CPUs: %s", exception_message(e));
+				exception_free(e);
+			}
+			else if (sched_getaffinity(0, sizeof(cpu_set_t), &kthreads_anycpu) != 0 || sched_setaffinity(0, sizeof(cpu_set_t), &kthreads_housekeeping) != 0)
+			{
+				LOGK(LOG_WARN, "Could not move the mainloop to CPUs %s: %s", housekeeping, strerror(errno));
+			}
+			else
+			{
+				kthreads_hashousekeeping = true;
+				LOGK(LOG_INFO, "Mainloop runs on housekeeping CPUs %s", kthread_cpustring(&kthreads_housekeeping).string);
+			}
+		}
+
 		// Free the configuration struct
 		cfg_free(cfg);
 	}
@@ -1990,6 +2358,22 @@ int main(int argc, char * argv[])
 				// Will exit
 			}
 		}
+
+		// Grow or trim the buffer pool every second
+		{
+			exception_t * e = NULL;
+			if (!watcher_newtimer(&buffer_timer, "Buffer pool task handler", BUFFER_TASK_PERIOD, bufferpool_dotasks, NULL, &e) || exception_check(&e))
+			{
+				LOGK(LOG_FATAL, "Could not create buffer pool task handler timer: %s", exception_message(e));
+				// Will exit
+			}
+
+			if (!mainloop_addwatcher(kernel_mainloop(), watcher_cast(&buffer_timer), &e) || exception_check(&e))
+			{
+				LOGK(LOG_FATAL, "Could not add buffer pool task handler to mainloop: %s", exception_message(e));
+				// Will exit
+			}
+		}
 	}
 
 	// Run maxkernel mainloop
@@ -7,6 +7,7 @@
 #include <stdbool.h>
 
 #include <aul/common.h>
+#include <aul/atomic.h>
 #include <aul/version.h>
 #include <aul/exception.h>
 #include <aul/constraint.h>
@@ -113,10 +114,25 @@ void property_clear(const char * name);
 const char * property_get(const char * name);
 bool property_isset(const char * name);
 
+typedef const void * porthandle_t;
 const void * rategroup_input(const char * name);
 void rategroup_output(const char * name, const void * output);
-#define input(name)					rategroup_input(#name)
-#define output(name, value)			rategroup_output(#name, value)
+porthandle_t rategroup_porthandle(const char * name);
+const void * rategroup_input_h(porthandle_t handle);
+void rategroup_output_h(porthandle_t handle, const void * output);
+bool rategroup_inputchanged_h(porthandle_t handle);
+#define input_handle(name)			rategroup_porthandle(#name)
+#define output_handle(name)			rategroup_porthandle(#name)
+#define input_h(handle)				rategroup_input_h(handle)
+#define output_h(handle, value)		rategroup_output_h(handle, value)
+#define input_changed_h(handle)		rategroup_inputchanged_h(handle)
+
+// Each call site resolves its port name once and then looks it up by handle. Block instances can update on several
+// threads at once, so the cached handle is read and published atomically (racing first calls resolve the same handle)
+#define __porthandle(handle, name)	({ porthandle_t __handle = atomic_get(handle); if unlikely(__handle == NULL) { __handle = rategroup_porthandle(name); atomic_set(handle, __handle); } __handle; })
+#define input(name)					({ static porthandle_t __input_handle = NULL; rategroup_input_h(__porthandle(__input_handle, #name)); })
+#define output(name, value)			({ static porthandle_t __output_handle = NULL; rategroup_output_h(__porthandle(__output_handle, #name), value); })
+#define input_changed(name)			({ static porthandle_t __input_handle = NULL; rategroup_inputchanged_h(__porthandle(__input_handle, #name)); })	// Input written since the last update
 
 const char * max_model();
 const char * kernel_id();
@@ -22,6 +22,7 @@ extern "C" {
 #define MODEL_SIZE_SIGNATURE			META_SIZE_SIGNATURE
 #define MODEL_SIZE_DESCRIPTION			META_SIZE_SHORTDESCRIPTION
 #define MODEL_SIZE_VALUE				150
+#define MODEL_SIZE_CPUS					64							// CPU list (ex. '2-3,6') a rategroup is pinned to
 #define MODEL_SIZE_BLOCKIONAME			(MODEL_SIZE_NAME + 6)	// Support array indexes on end of name (ex. '[25]')
 #define MODEL_SIZE_MAX \
 	(MMAX(MODEL_SIZE_PATH,			\
@@ -40,6 +41,7 @@ extern "C" {
 #define MODEL_MAX_LINKABLES				(25 /* Blockinsts */ + 25 /* Syscalls */ + 10 /* Rategroups */ )		// Maximum number of block instances per script
 #define MODEL_MAX_LINKS					(MODEL_MAX_LINKABLES * 20)	// Maximum number of links per script
 #define MODEL_MAX_RATEGROUPELEMS		15							// Maximum number of block instances registered to a rategroup
+#define MODEL_MAX_RATEGROUPWORKERS		8							// Maximum number of worker threads per rategroup
 #define MODEL_MAX_IDS								\
 	( 1 ) +											\
 	( MODEL_MAX_SCRIPTS ) + 						\
@@ -69,6 +71,24 @@ typedef enum
 	model_link			= (0x1 << 8),
 } modeltype_t;
 
+typedef enum
+{
+	model_linkdefault		= 0,
+	model_linktriplebuffer	= 1,		// Wait-free on both ends, the reader always gets the newest complete value
+} model_linkmode_t;
+
+typedef enum
+{
+	model_overrunskip		= 0,		// Drop the missed periods and resume on the next deadline of the original schedule
+	model_overruncatchup	= 1,		// Run the missed periods back to back until the schedule is caught up
+} model_overrun_t;
+
+typedef enum
+{
+	model_schedroundrobin	= 0,		// SCHED_RR at the rategroup priority, woken by its clock
+	model_scheddeadline		= 1,		// SCHED_DEADLINE (runtime measured at startup), woken by the kernel every period
+} model_schedmode_t;
+
 // TODO - figure out if we should delete this!
 #define model_linkable(x)		((x) & (model_blockinst | model_syscall | model_rategroup))
 
@@ -118,6 +138,10 @@ typedef struct
 	char name[MODEL_SIZE_NAME];
 	int priority;
 	double hertz;
+	model_overrun_t overrun;
+	char cpus[MODEL_SIZE_CPUS];			// Empty if the rategroup isn't pinned
+	model_schedmode_t sched;
+	size_t workers;						// Extra threads for the block instances that don't depend on each other, 0 runs them all in order
 	const struct __model_linkable_t * blockinsts[MODEL_MAX_RATEGROUPELEMS + MODEL_SENTINEL];
 } model_rategroup_t;
 
@@ -152,6 +176,7 @@ typedef struct
 
 	model_linksymbol_t out;
 	model_linksymbol_t in;
+	model_linkmode_t mode;
 } model_link_t;
 
 typedef struct
@@ -224,6 +249,11 @@ model_linkable_t * model_newblockinst(model_t * model, model_module_t * module,
 model_linkable_t * model_newrategroup(model_t * model, model_script_t * script, const char * name, int priority, double hertz, const model_linkable_t ** elems, size_t elems_length, exception_t ** err);
 model_linkable_t * model_newsyscall(model_t * model, model_script_t * script, const char * funcname, const char * sig, const char * desc, exception_t ** err);
 model_link_t * model_newlink(model_t * model, model_script_t * script, model_linkable_t * outinst, const char * outname, model_linkable_t * ininst, const char * inname, exception_t ** err);
+bool model_setlinkmode(model_link_t * link, model_linkmode_t mode, exception_t ** err);
+bool model_setrategroupoverrun(model_linkable_t * linkable, model_overrun_t overrun, exception_t ** err);
+bool model_setrategroupcpus(model_linkable_t * linkable, const char * cpus, exception_t ** err);
+bool model_setrategroupsched(model_linkable_t * linkable, model_schedmode_t sched, exception_t ** err);
+bool model_setrategroupworkers(model_linkable_t * linkable, size_t workers, exception_t ** err);
 
 void model_analyse(model_t * model, const model_analysis_t * funcs);
 
@@ -256,7 +286,12 @@ void model_getconfig(const model_config_t * config, const char ** name, char * s
 void model_getblockinst(const model_linkable_t * linkable, const char ** name, const model_module_t ** module, const char ** sig, const char * const ** args, size_t * argslen);
 void model_getsyscall(const model_linkable_t * linkable, const char ** name, const char ** sig, const char ** desc);
 void model_getrategroup(const model_linkable_t * linkable, const char ** name, int * priority, double * hertz);
+void model_getrategroupoverrun(const model_linkable_t * linkable, model_overrun_t * overrun);
+void model_getrategroupcpus(const model_linkable_t * linkable, const char ** cpus);
+void model_getrategroupsched(const model_linkable_t * linkable, model_schedmode_t * sched);
+void model_getrategroupworkers(const model_linkable_t * linkable, size_t * workers);
 void model_getlink(const model_link_t * link, const model_linksymbol_t ** out, const model_linksymbol_t ** in);
+void model_getlinkmode(const model_link_t * link, model_linkmode_t * mode);
 void model_getlinksymbol(const model_linksymbol_t * symbol, const model_linkable_t ** linkable, const char ** name, bool * hasindex, size_t * index);
 
 
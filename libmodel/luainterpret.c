@@ -196,9 +196,21 @@ static int l_route(lua_State * L)
 		return luaL_error(L, "Input not a valid linkable!");
 	}
 
+	model_linkmode_t mode = model_linkdefault;
+	if (lua_gettop(L) >= 3)
+	{
+		const char * modename = luaL_checkstring(L, 3);
+		if (strcmp(modename, "default") == 0)				mode = model_linkdefault;
+		else if (strcmp(modename, "triplebuffer") == 0)		mode = model_linktriplebuffer;
+		else
+		{
+			return luaL_error(L, "Unknown link mode '%s' (Only options: 'default', 'triplebuffer')", modename);
+		}
+	}
+
 	exception_t * e = NULL;
 	model_link_t * link = model_newlink(env->model, env->script, (model_linkable_t *)out->head, out->name, (model_linkable_t *)in->head, in->name, &e);
-	if (link == NULL || exception_check(&e))
+	if (link == NULL || exception_check(&e) || !model_setlinkmode(link, mode, &e))
 	{
 		return luaL_error(L, "link failed: %s", exception_message(e));
 	}
@@ -218,6 +230,43 @@ static int l_newrategroup(lua_State * L)
 	int priority = luaL_checkinteger(L, 2);
 	double rate_hz = luaL_checknumber(L, 4);
 
+	model_overrun_t overrun = model_overrunskip;
+	if (lua_gettop(L) >= 5)
+	{
+		const char * overrunname = luaL_checkstring(L, 5);
+		if (strcmp(overrunname, "skip") == 0)				overrun = model_overrunskip;
+		else if (strcmp(overrunname, "catchup") == 0)		overrun = model_overruncatchup;
+		else
+		{
+			return luaL_error(L, "Unknown overrun policy '%s' (Only options: 'skip', 'catchup')", overrunname);
+		}
+	}
+
+	const char * cpus = "";
+	if (lua_gettop(L) >= 6)
+	{
+		cpus = luaL_checkstring(L, 6);
+	}
+
+	model_schedmode_t sched = model_schedroundrobin;
+	if (lua_gettop(L) >= 7)
+	{
+		const char * schedname = luaL_checkstring(L, 7);
+		if (strcmp(schedname, "roundrobin") == 0)			sched = model_schedroundrobin;
+		else if (strcmp(schedname, "deadline") == 0)		sched = model_scheddeadline;
+		else
+		{
+			return luaL_error(L, "Unknown scheduling mode '%s' (Only options: 'roundrobin', 'deadline')", schedname);
+		}
+	}
+
+	int workers = 0;
+	if (lua_gettop(L) >= 8)
+	{
+		workers = luaL_checkinteger(L, 8);
+		luaL_argcheck(L, workers >= 0, 8, "must not be negative (worker threads)");
+	}
+
 	size_t index = 0;
 	const model_linkable_t * blockinsts[MODEL_MAX_RATEGROUPELEMS] = { NULL };
 
@@ -243,7 +292,7 @@ static int l_newrategroup(lua_State * L)
 
 	exception_t * e = NULL;
 	model_linkable_t * rg = model_newrategroup(env->model, env->script, name, priority, rate_hz, blockinsts, index, &e);
-	if (rg == NULL || exception_check(&e))
+	if (rg == NULL || exception_check(&e) || !model_setrategroupoverrun(rg, overrun, &e) || !model_setrategroupcpus(rg, cpus, &e) || !model_setrategroupsched(rg, sched, &e) || !model_setrategroupworkers(rg, workers, &e))
 	{
 		return luaL_error(L, "rategroup failed: %s", exception_message(e));
 	}
@@ -855,6 +855,10 @@ model_linkable_t * model_newrategroup(model_t * model, model_script_t * script,
 	strcpy(rategroup->name, groupname);
 	rategroup->priority = priority;
 	rategroup->hertz = hertz;
+	rategroup->overrun = model_overrunskip;
+	rategroup->cpus[0] = '\0';
+	rategroup->sched = model_schedroundrobin;
+	rategroup->workers = 0;
 	for (size_t i = 0; i < elems_length; i++)
 	{
 		rategroup->blockinsts[i] = elems[i];
@@ -1170,10 +1174,162 @@ model_link_t * model_newlink(model_t * model, model_script_t * script, model_lin
 
 	link->out = outsym;
 	link->in = insym;
+	link->mode = model_linkdefault;
 
 	return link;
 }
 
+bool model_setlinkmode(model_link_t * link, model_linkmode_t mode, exception_t ** err)
+{
+	// Sanity check
+	{
+		if unlikely(exception_check(err))
+		{
+			return false;
+		}
+
+		if unlikely(link == NULL)
+		{
+			exception_set(err, EINVAL, "Bad arguments!");
+			return false;
+		}
+	}
+
+	switch (mode)
+	{
+		case model_linkdefault:
+		case model_linktriplebuffer:
+			link->mode = mode;
+			return true;
+
+		default:
+		{
+			exception_set(err, EINVAL, "Unknown link mode %d", mode);
+			return false;
+		}
+	}
+}
+
+bool model_setrategroupoverrun(model_linkable_t * linkable, model_overrun_t overrun, exception_t ** err)
+{
+	// Sanity check
+	{
+		if unlikely(exception_check(err))
+		{
+			return false;
+		}
+
+		if unlikely(linkable == NULL || model_type(model_object(linkable)) != model_rategroup)
+		{
+			exception_set(err, EINVAL, "Bad arguments!");
+			return false;
+		}
+	}
+
+	switch (overrun)
+	{
+		case model_overrunskip:
+		case model_overruncatchup:
+			linkable->backing.rategroup->overrun = overrun;
+			return true;
+
+		default:
+		{
+			exception_set(err, EINVAL, "Unknown overrun policy %d", overrun);
+			return false;
+		}
+	}
+}
+
+bool model_setrategroupcpus(model_linkable_t * linkable, const char * cpus, exception_t ** err)
+{
+	// Sanity check
+	{
+		if unlikely(exception_check(err))
+		{
+			return false;
+		}
+
+		if unlikely(linkable == NULL || cpus == NULL || model_type(model_object(linkable)) != model_rategroup)
+		{
+			exception_set(err, EINVAL, "Bad arguments!");
+			return false;
+		}
+
+		if unlikely(strlen(cpus) >= MODEL_SIZE_CPUS)
+		{
+			exception_set(err, ENOMEM, "Rategroup CPU list is too long! (MODEL_SIZE_CPUS = %d)", MODEL_SIZE_CPUS);
+			return false;
+		}
+
+		if unlikely(strspn(cpus, "0123456789,-") != strlen(cpus))
+		{
+			exception_set(err, EINVAL, "Bad rategroup CPU list '%s' (expected a list like '2-3,6')", cpus);
+			return false;
+		}
+	}
+
+	strcpy(linkable->backing.rategroup->cpus, cpus);
+	return true;
+}
+
+bool model_setrategroupsched(model_linkable_t * linkable, model_schedmode_t sched, exception_t ** err)
+{
+	// Sanity check
+	{
+		if unlikely(exception_check(err))
+		{
+			return false;
+		}
+
+		if unlikely(linkable == NULL || model_type(model_object(linkable)) != model_rategroup)
+		{
+			exception_set(err, EINVAL, "Bad arguments!");
+			return false;
+		}
+	}
+
+	switch (sched)
+	{
+		case model_schedroundrobin:
+		case model_scheddeadline:
+			linkable->backing.rategroup->sched = sched;
+			return true;
+
+		default:
+		{
+			exception_set(err, EINVAL, "Unknown scheduling mode %d", sched);
+			return false;
+		}
+	}
+}
+
+bool model_setrategroupworkers(model_linkable_t * linkable, size_t workers, exception_t ** err)
+{
+	// Sanity check
+	{
+		if unlikely(exception_check(err))
+		{
+			return false;
+		}
+
+		if unlikely(linkable == NULL || model_type(model_object(linkable)) != model_rategroup)
+		{
+			exception_set(err, EINVAL, "Bad arguments!");
+			return false;
+		}
+
+		if unlikely(workers > MODEL_MAX_RATEGROUPWORKERS)
+		{
+			exception_set(err, EINVAL, "Too many rategroup workers %zu (MODEL_MAX_RATEGROUPWORKERS = %d)", workers, MODEL_MAX_RATEGROUPWORKERS);
+			return false;
+		}
+	}
+
+	linkable->backing.rategroup->workers = workers;
+	return true;
+}
+
 void model_analyse(model_t * model, const model_analysis_t * funcs)
 {
 	// Sanity check
@@ -1622,6 +1778,71 @@ void model_getlink(const model_link_t * link, const model_linksymbol_t ** out, c
 	if (in != NULL)				*in = &link->in;
 }
 
+void model_getrategroupoverrun(const model_linkable_t * linkable, model_overrun_t * overrun)
+{
+	// Sanity check
+	{
+		if unlikely(linkable == NULL || model_type(model_object(linkable)) != model_rategroup)
+		{
+			return;
+		}
+	}
+
+	if (overrun != NULL)		*overrun = linkable->backing.rategroup->overrun;
+}
+
+void model_getrategroupcpus(const model_linkable_t * linkable, const char ** cpus)
+{
+	// Sanity check
+	{
+		if unlikely(linkable == NULL || model_type(model_object(linkable)) != model_rategroup)
+		{
+			return;
+		}
+	}
+
+	if (cpus != NULL)			*cpus = linkable->backing.rategroup->cpus;
+}
+
+void model_getrategroupsched(const model_linkable_t * linkable, model_schedmode_t * sched)
+{
+	// Sanity check
+	{
+		if unlikely(linkable == NULL || model_type(model_object(linkable)) != model_rategroup)
+		{
+			return;
+		}
+	}
+
+	if (sched != NULL)			*sched = linkable->backing.rategroup->sched;
+}
+
+void model_getrategroupworkers(const model_linkable_t * linkable, size_t * workers)
+{
+	// Sanity check
+	{
+		if unlikely(linkable == NULL || model_type(model_object(linkable)) != model_rategroup)
+		{
+			return;
+		}
+	}
+
+	if (workers != NULL)		*workers = linkable->backing.rategroup->workers;
+}
+
+void model_getlinkmode(const model_link_t * link, model_linkmode_t * mode)
+{
+	// Sanity check
+	{
+		if unlikely(link == NULL)
+		{
+			return;
+		}
+	}
+
+	if (mode != NULL)			*mode = link->mode;
+}
+
 void model_getlinksymbol(const model_linksymbol_t * symbol, const model_linkable_t ** linkable, const char ** name, bool * hasindex, size_t * index)
 {
 	// Sanity check
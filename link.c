@@ -3,6 +3,7 @@
 #include <aul/string.h>
 #include <aul/exception.h>
 #include <aul/mutex.h>
+#include <aul/atomic.h>
 
 #include <maxmodel/meta.h>
 #include <maxmodel/model.h>
@@ -14,12 +15,316 @@
 #include <kernel-priv.h>
 
 
-extern mutex_t io_lock;
+typedef struct
+{
+	iobacking_t * backing;
+	size_t offset;
+	uint32_t generation;
+} linkitem_t;
+
+typedef struct
+{
+	// One resolved link (or batch of indexed links) in a compiled plan
+	link_t * link;
+	linkbatch_t * batch;
+	iobacking_t * port;
+} linkstep_t;
+
+struct __linkplan_t
+{
+	// Flat list of the links to run for one side of a block instance, compiled once by link_compile
+	meta_iotype_t type;
+	size_t count;
+	linkstep_t steps[0];
+};
+
+struct __linkbatch_t
+{
+	// A run of indexed links that scatter into (or gather from) the same array port
+	size_t count;
+	size_t end;				// The array must hold this many bytes for the largest index
+	list_t * last;			// Last link of the run, the rest of the run is handled by the first
+	uint32_t generation;	// Generation of the array port at the last gather
+	linkitem_t items[0];	// Sorted by offset
+};
+
+struct __linksync_t
+{
+	// Triple buffer between the two ends of one connection. Each end owns a private backing that
+	// it reads or writes at leisure, only the middle backing changes hands (with one atomic exchange)
+	size_t refs;
+	uintptr_t middle;		// Tagged with LINK_FRESH when the writer has published since the last read
+};
+
+#define LINK_FRESH				((uintptr_t)0x1)
+
+#define LINK_SNAPSHOTSIZE		(sizeof(iobacking_t) + sizeof(char *) + AUL_STRING_MAXLEN)		// Largest value backing (a string)
+
+static void copy_d2D(const void * linkdata, const void * from, bool from_isnull, void * to, bool to_isnull);
+static void copy_D2d(const void * linkdata, const void * from, bool from_isnull, void * to, bool to_isnull);
 
 static inline void link_handle(const link_f function, const void * data, const iobacking_t * from, iobacking_t * to)
 {
 	function(data, from->data, from->isnull, to->data, to->isnull);
 	to->isnull = from->isnull;
+	to->generation += 1;
+}
+
+// Each intermediate backing has a single writer, so the sequence count doesn't need atomic increments
+#define link_seqbegin(backing)	({ (backing)->seq += 1; atomic_wmb(); })
+#define link_seqend(backing)	({ atomic_wmb(); (backing)->seq += 1; })
+
+static inline void link_backoff(size_t attempt)
+{
+	// Give the writer time to finish, doubling the wait on each failed attempt
+	for (size_t i = 0; i < ((size_t)1 << attempt); i++)
+	{
+		atomic_relax();
+	}
+}
+
+static inline bool link_snapshot(const iobacking_t * from, iobacking_t * snapshot, size_t size)
+{
+	// Copy a value backing out from under its writer. Give up rather than spin on a preempted writer
+	for (size_t i = 0; i < LINK_READRETRIES; i++)
+	{
+		if (i > 0)
+		{
+			link_backoff(i);
+		}
+
+		uint32_t seq = from->seq;
+		if (seq & 1)
+		{
+			continue;
+		}
+
+		atomic_rmb();
+		snapshot->sig = from->sig;
+		snapshot->isnull = from->isnull;
+		snapshot->generation = from->generation;
+		memcpy(snapshot->data, from->data, size);
+		atomic_rmb();
+
+		if (from->seq == seq)
+		{
+			if (iobacking_sig(snapshot) == T_STRING)
+			{
+				// Point the string head at the snapshot's own storage
+				*(char **)snapshot->data = (char *)&snapshot->data[sizeof(char *)];
+			}
+
+			return true;
+		}
+	}
+
+	return false;
+}
+
+static inline void link_read(link_t * link, iobacking_t * to)
+{
+	if (link->sync != NULL)
+	{
+		// Take the newest value if the writer has published one since the last read
+		linksync_t * sync = link->sync;
+		if ((atomic_get(sync->middle) & LINK_FRESH) == 0)
+		{
+			return;
+		}
+
+		uintptr_t middle = atomic_xchg(sync->middle, (uintptr_t)link->backing);
+		link->backing = (iobacking_t *)(middle & ~LINK_FRESH);
+		link_handle(link->linkfunction, link->linkdata, link->backing, to);
+		return;
+	}
+
+	if (iobacking_generation(link->backing) == link->generation)
+	{
+		// Nothing new since the last copy
+		return;
+	}
+
+	uint64_t scratch[LINK_SNAPSHOTSIZE / sizeof(uint64_t) + 1];
+	iobacking_t * snapshot = (iobacking_t *)scratch;
+	if (link_snapshot(link->backing, snapshot, iobacking_size(iobacking_sig(link->backing))))
+	{
+		link_handle(link->linkfunction, link->linkdata, snapshot, to);
+		link->generation = iobacking_generation(snapshot);
+	}
+}
+
+static inline void link_write(link_t * link, const iobacking_t * from)
+{
+	if (iobacking_generation(from) == link->generation)
+	{
+		// The block didn't touch the output since the last copy
+		return;
+	}
+
+	link->generation = iobacking_generation(from);
+	if (link->sync != NULL)
+	{
+		// Fill our own backing first, then publish it in place of the middle one
+		link_handle(link->linkfunction, link->linkdata, from, link->backing);
+
+		uintptr_t middle = atomic_xchg(link->sync->middle, (uintptr_t)link->backing | LINK_FRESH);
+		link->backing = (iobacking_t *)(middle & ~LINK_FRESH);
+		return;
+	}
+
+	iobacking_t * to = link->backing;
+	link_seqbegin(to);
+	link_handle(link->linkfunction, link->linkdata, from, to);
+	link_seqend(to);
+}
+
+static void link_scatter(linkbatch_t * batch, iobacking_t * to)
+{
+	// Write every element of the run into the array, resolving each page of the array once
+	array_t ** array = (array_t **)iobacking_data(to);
+	if (iobacking_isnull(to))
+	{
+		*array = buffer_newinline(iobacking_inline(array));
+	}
+
+	if (buffer_isinline(*array) && batch->end > BUFFER_INLINECAPACITY && iobacking_spill(array) == NULL)
+	{
+		return;
+	}
+
+	if (iobacking_unshare(array) == NULL)
+	{
+		return;
+	}
+
+	bufferpos_t pos;
+	uint8_t * span = NULL;
+	size_t spanstart = 0, spanend = 0, high = 0;
+	bool written = false;
+
+	uint64_t scratch[(sizeof(iobacking_t) + sizeof(double)) / sizeof(uint64_t) + 1];
+	iobacking_t * from = (iobacking_t *)scratch;
+
+	void commit()
+	{
+		if (span != NULL && high > spanstart)
+		{
+			bufferpos_new(&pos, *array, spanstart);
+			buffer_commit(&pos, high - spanstart);
+		}
+	}
+
+	for (size_t i = 0; i < batch->count; i++)
+	{
+		linkitem_t * item = &batch->items[i];
+		size_t offset = item->offset;
+		if (iobacking_generation(item->backing) == item->generation || !link_snapshot(item->backing, from, sizeof(double)))
+		{
+			continue;
+		}
+
+		item->generation = iobacking_generation(from);
+		if (iobacking_isnull(from))
+		{
+			continue;
+		}
+
+		written = true;
+		if (offset < spanstart || offset + sizeof(double) > spanend)
+		{
+			commit();
+
+			bufferpos_new(&pos, *array, offset);
+			size_t length = min(bufferpos_span(&pos), batch->end - offset);
+			span = (length >= sizeof(double))? buffer_reserve(&pos, length) : NULL;
+			spanstart = high = offset;
+			spanend = (span == NULL)? offset : offset + length;
+
+			if (span == NULL)
+			{
+				// The element straddles a page boundary (or the pool is exhausted), write it the slow way
+				array_writeindex(*array, T_ARRAY_DOUBLE, offset / sizeof(double), iobacking_data(from));
+				continue;
+			}
+		}
+
+		memcpy(&span[offset - spanstart], iobacking_data(from), sizeof(double));
+		high = offset + sizeof(double);
+	}
+
+	commit();
+	if (written)
+	{
+		iobacking_isnull(to) = false;
+		iobacking_generation(to) += 1;
+	}
+}
+
+static void link_gather(linkbatch_t * batch, const iobacking_t * from)
+{
+	// Read every element of the run out of the array, resolving each page of the array once
+	if (iobacking_generation(from) == batch->generation)
+	{
+		return;
+	}
+
+	batch->generation = iobacking_generation(from);
+	if (iobacking_isnull(from))
+	{
+		for (size_t i = 0; i < batch->count; i++)
+		{
+			iobacking_t * to = batch->items[i].backing;
+			link_seqbegin(to);
+			iobacking_isnull(to) = true;
+			iobacking_generation(to) += 1;
+			link_seqend(to);
+		}
+
+		return;
+	}
+
+	const array_t * array = *(const array_t **)iobacking_data(from);
+	size_t size = buffer_size(array);
+
+	bufferpos_t pos;
+	const uint8_t * span = NULL;
+	size_t spanstart = 0, spanend = 0;
+
+	for (size_t i = 0; i < batch->count; i++)
+	{
+		iobacking_t * to = batch->items[i].backing;
+		size_t offset = batch->items[i].offset;
+		double * value = iobacking_data(to);
+		link_seqbegin(to);
+
+		if (offset < spanstart || offset + sizeof(double) > spanend)
+		{
+			bufferpos_new(&pos, (array_t *)array, offset);
+			size_t length = (offset < size)? min(bufferpos_span(&pos), size - offset) : 0;
+			span = (length >= sizeof(double))? buffer_peek(&pos, length) : NULL;
+			spanstart = offset;
+			spanend = (span == NULL)? offset : offset + length;
+
+			if (span == NULL)
+			{
+				// The element straddles a page boundary or is past the end of the array
+				if (!array_readindex(array, T_ARRAY_DOUBLE, offset / sizeof(double), value))
+				{
+					*value = 0.0;
+				}
+
+				iobacking_isnull(to) = false;
+				iobacking_generation(to) += 1;
+				link_seqend(to);
+				continue;
+			}
+		}
+
+		memcpy(value, &span[offset - spanstart], sizeof(double));
+		iobacking_isnull(to) = false;
+		iobacking_generation(to) += 1;
+		link_seqend(to);
+	}
 }
 
 iobacking_t * link_connect(const model_link_t * link, char outsig, linklist_t * outlinks, char insig, linklist_t * inlinks, exception_t ** err)
@@ -144,6 +449,8 @@ iobacking_t * link_connect(const model_link_t * link, char outsig, linklist_t *
 	match(	T_ARRAY_BOOLEAN,	true,		T_INTEGER,			false,		T_BOOLEAN);
 	matchi(	T_ARRAY_BOOLEAN,	true,		T_DOUBLE,			false,		T_BOOLEAN,		"Unusual link type");
 	match(	T_ARRAY_BOOLEAN,	false,		T_ARRAY_BOOLEAN,	false,		T_ARRAY_BOOLEAN);
+	matchi(	T_ARRAY_BOOLEAN,	false,		T_ARRAY_INTEGER,	false,		T_ARRAY_BOOLEAN,	"Unusual link type");
+	matchi(	T_ARRAY_BOOLEAN,	false,		T_ARRAY_DOUBLE,		false,		T_ARRAY_BOOLEAN,	"Unusual link type");
 	match(	T_ARRAY_BOOLEAN,	true,		T_ARRAY_BOOLEAN,	true,		T_BOOLEAN);
 	match(	T_ARRAY_BOOLEAN,	true,		T_ARRAY_INTEGER,	true,		T_BOOLEAN);
 	matchi(	T_ARRAY_BOOLEAN,	true,		T_ARRAY_DOUBLE,		true,		T_BOOLEAN,		"Unusual link type");
@@ -153,6 +460,8 @@ iobacking_t * link_connect(const model_link_t * link, char outsig, linklist_t *
 	match(	T_ARRAY_INTEGER,	true,		T_INTEGER,			false,		T_INTEGER);
 	match(	T_ARRAY_INTEGER,	true,		T_DOUBLE,			false,		T_INTEGER);
 	match(	T_ARRAY_INTEGER,	false,		T_ARRAY_INTEGER,	false,		T_ARRAY_INTEGER);
+	match(	T_ARRAY_INTEGER,	false,		T_ARRAY_BOOLEAN,	false,		T_ARRAY_INTEGER);
+	matchi(	T_ARRAY_INTEGER,	false,		T_ARRAY_DOUBLE,		false,		T_ARRAY_INTEGER,	"Possible loss of precision");
 	match(	T_ARRAY_INTEGER,	true,		T_ARRAY_INTEGER,	true,		T_INTEGER);
 
 	// Match double array -> ?
@@ -160,6 +469,8 @@ iobacking_t * link_connect(const model_link_t * link, char outsig, linklist_t *
 	matchi(	T_ARRAY_DOUBLE,		true,		T_INTEGER,			false,		T_DOUBLE,		"Possible loss of precision");
 	match(	T_ARRAY_DOUBLE,		true,		T_DOUBLE,			false,		T_DOUBLE);
 	match(	T_ARRAY_DOUBLE,		false,		T_ARRAY_DOUBLE,		false,		T_ARRAY_DOUBLE);
+	matchi(	T_ARRAY_DOUBLE,		false,		T_ARRAY_BOOLEAN,	false,		T_ARRAY_DOUBLE,		"Unusual link type");
+	match(	T_ARRAY_DOUBLE,		false,		T_ARRAY_INTEGER,	false,		T_ARRAY_DOUBLE);
 	match(	T_ARRAY_DOUBLE,		true,		T_ARRAY_DOUBLE,		true,		T_DOUBLE);
 
 	// Match buffer -> ?
@@ -206,6 +517,36 @@ iobacking_t * link_connect(const model_link_t * link, char outsig, linklist_t *
 		return false;
 	}
 
+	// Arrays and buffers can't be copied out from under the writer (and triple buffered links ask not to be),
+	// so give each end its own backing and only hand the middle one back and forth
+	model_linkmode_t mode = model_linkdefault;
+	model_getlinkmode(link, &mode);
+
+	bool triplebuffer = (mode == model_linktriplebuffer);
+	switch (sig)
+	{
+		case T_ARRAY_BOOLEAN:
+		case T_ARRAY_INTEGER:
+		case T_ARRAY_DOUBLE:
+		case T_BUFFER:
+			triplebuffer = true;
+			break;
+
+		default: break;
+	}
+
+	if (triplebuffer)
+	{
+		linksync_t * sync = malloc(sizeof(linksync_t));
+		memset(sync, 0, sizeof(linksync_t));
+		sync->refs = 2;
+		sync->middle = (uintptr_t)backing;
+
+		outlink->sync = inlink->sync = sync;
+		outlink->backing = iobacking_new(sig, NULL);
+		inlink->backing = iobacking_new(sig, NULL);
+	}
+
 	// Now install the link
 	list_add(&outlinks->outputs, &outlink->link_list);
 	list_add(&inlinks->inputs, &inlink->link_list);
@@ -237,10 +578,16 @@ void link_destroy(linklist_t * links)
 
 			// Don't free link->backing. It is a shared backing between output and input.
 
+			if (link->sync != NULL && atomic_dec(link->sync->refs) == 0)
+			{
+				free(link->sync);
+			}
+
 			if (link->linkdata != NULL)
 			{
 				free(link->linkdata);
 			}
+			free(link->batch);
 			free(link);
 		}
 	}
@@ -255,15 +602,51 @@ void link_destroy(linklist_t * links)
 
 			// Don't free link->backing. It is a shared backing between output and input.
 
+			if (link->sync != NULL && atomic_dec(link->sync->refs) == 0)
+			{
+				free(link->sync);
+			}
+
 			if (link->linkdata != NULL)
 			{
 				free(link->linkdata);
 			}
+			free(link->batch);
 			free(link);
 		}
 	}
 }
 
+bool link_isconnected(const linklist_t * outlinks, const linklist_t * inlinks)
+{
+	// Sanity check
+	{
+		if unlikely(outlinks == NULL || inlinks == NULL)
+		{
+			return false;
+		}
+	}
+
+	// Both ends of a connection share its intermediate backing (or its triple buffer, each end then has a private backing)
+	list_t * outpos = NULL;
+	list_foreach(outpos, &outlinks->outputs)
+	{
+		const link_t * outlink = list_entry(outpos, link_t, link_list);
+
+		list_t * inpos = NULL;
+		list_foreach(inpos, &inlinks->inputs)
+		{
+			const link_t * inlink = list_entry(inpos, link_t, link_list);
+			if ((outlink->sync != NULL)? outlink->sync == inlink->sync : outlink->backing == inlink->backing)
+			{
+				return true;
+			}
+		}
+	}
+
+	return false;
+}
+
 void link_doinputs(portlist_t * ports, linklist_t * links)
 {
 	// Sanity check
@@ -288,7 +671,6 @@ void link_doinputs(portlist_t * ports, linklist_t * links)
 		return;
 	}
 
-	mutex_lock(&io_lock);
 	{
 		list_t * pitem = list_next(ports);
 
@@ -314,10 +696,17 @@ void link_doinputs(portlist_t * ports, linklist_t * links)
 				port = list_entry(pitem, port_t, port_list);
 			}
 
-			link_handle(link->linkfunction, link->linkdata, link->backing, port->backing);
+			if (link->batch != NULL)
+			{
+				// Scatter the whole run of indexed links into the array and skip past it
+				link_scatter(link->batch, port->backing);
+				pos = link->batch->last;
+				continue;
+			}
+
+			link_read(link, port->backing);
 		}
 	}
-	mutex_unlock(&io_lock);
 }
 
 void link_dooutputs(portlist_t * ports, linklist_t * links)
@@ -344,7 +733,6 @@ void link_dooutputs(portlist_t * ports, linklist_t * links)
 		return;
 	}
 
-	mutex_lock(&io_lock);
 	{
 		list_t * pitem = list_next(ports);
 
@@ -370,10 +758,192 @@ void link_dooutputs(portlist_t * ports, linklist_t * links)
 				port = list_entry(pitem, port_t, port_list);
 			}
 
-			link_handle(link->linkfunction, link->linkdata, port->backing, link->backing);
+			if (link->batch != NULL)
+			{
+				// Gather the whole run of indexed links out of the array and skip past it
+				link_gather(link->batch, port->backing);
+				pos = link->batch->last;
+				continue;
+			}
+
+			link_write(link, port->backing);
+		}
+	}
+}
+
+linkplan_t * link_compile(portlist_t * ports, linklist_t * links, meta_iotype_t type, exception_t ** err)
+{
+	// Sanity check
+	{
+		if unlikely(exception_check(err))
+		{
+			return NULL;
+		}
+
+		if unlikely(ports == NULL || links == NULL || (type != meta_input && type != meta_output))
+		{
+			exception_set(err, EINVAL, "Bad arguments!");
+			return NULL;
+		}
+	}
+
+	list_t * list = (type == meta_input)? &links->inputs : &links->outputs;
+
+	// Size the plan for one step per link (batches only make it shorter)
+	size_t length = 0;
+	{
+		list_t * pos = NULL;
+		list_foreach(pos, list)
+		{
+			length += 1;
+		}
+	}
+
+	linkplan_t * plan = malloc(sizeof(linkplan_t) + sizeof(linkstep_t) * length);
+	memset(plan, 0, sizeof(linkplan_t) + sizeof(linkstep_t) * length);
+
+	list_t * pos = NULL;
+	list_foreach(pos, list)
+	{
+		link_t * link = list_entry(pos, link_t, link_list);
+
+		const char * symbol_name = NULL;
+		model_getlinksymbol(link->symbol, NULL, &symbol_name, NULL, NULL);
+
+		port_t * port = port_lookup(ports, type, symbol_name);
+		if (port == NULL)
+		{
+			exception_set(err, ENOENT, "Could not find %s port symbol %s in portlist!", (type == meta_input)? "input" : "output", symbol_name);
+			free(plan);
+			return NULL;
+		}
+
+		linkstep_t * step = &plan->steps[plan->count++];
+		if (link->batch != NULL)
+		{
+			// The whole run of indexed links becomes one step
+			step->batch = link->batch;
+			step->port = port->backing;
+			pos = link->batch->last;
+			continue;
+		}
+
+		step->link = link;
+		step->port = port->backing;
+	}
+
+	plan->type = type;
+	return plan;
+}
+
+void link_runplan(const linkplan_t * plan)
+{
+	// Sanity check
+	{
+		if unlikely(plan == NULL)
+		{
+			LOGK(LOG_ERR, "Invalid parameters!");
+			return;
+		}
+	}
+
+	if (plan->count == 0)
+	{
+		return;
+	}
+
+	for (size_t i = 0; i < plan->count; i++)
+	{
+		const linkstep_t * step = &plan->steps[i];
+		if (step->batch != NULL)
+		{
+			if (plan->type == meta_input)	link_scatter(step->batch, step->port);
+			else							link_gather(step->batch, step->port);
+			continue;
+		}
+
+		if (plan->type == meta_input)	link_read(step->link, step->port);
+		else							link_write(step->link, step->port);
+	}
+}
+
+static void link_batch(list_t * links, link_f function)
+{
+	int batch_compare(const void * a, const void * b)
+	{
+		size_t oa = ((const linkitem_t *)a)->offset;
+		size_t ob = ((const linkitem_t *)b)->offset;
+		return (oa < ob)? -1 : ((oa > ob)? 1 : 0);
+	}
+
+	bool batchable(list_t * entry, const char * name)
+	{
+		if (entry == links)
+		{
+			return false;
+		}
+
+		link_t * link = list_entry(entry, link_t, link_list);
+
+		const char * linkname = NULL;
+		bool hasindex = false;
+		model_getlinksymbol(link_symbol(link), NULL, &linkname, &hasindex, NULL);
+		return link->linkfunction == function && link->sync == NULL && hasindex && (name == NULL || strcmp(name, linkname) == 0);
+	}
+
+	// Throw away the batches from the last sort
+	list_t * pos = NULL;
+	list_foreach(pos, links)
+	{
+		link_t * link = list_entry(pos, link_t, link_list);
+		free(link->batch);
+		link->batch = NULL;
+	}
+
+	list_foreach(pos, links)
+	{
+		if (!batchable(pos, NULL))
+		{
+			continue;
+		}
+
+		link_t * first = list_entry(pos, link_t, link_list);
+		const char * name = NULL;
+		model_getlinksymbol(link_symbol(first), NULL, &name, NULL, NULL);
+
+		// Find the run of indexed links on the same array
+		size_t count = 1;
+		list_t * last = pos;
+		while (batchable(last->next, name))
+		{
+			last = last->next;
+			count += 1;
+		}
+
+		if (count > 1)
+		{
+			linkbatch_t * batch = malloc(sizeof(linkbatch_t) + sizeof(linkitem_t) * count);
+			batch->count = count;
+			batch->end = 0;
+			batch->last = last;
+			batch->generation = 0;
+
+			list_t * entry = pos;
+			for (size_t i = 0; i < count; i++, entry = entry->next)
+			{
+				link_t * link = list_entry(entry, link_t, link_list);
+				batch->items[i].backing = link->backing;
+				batch->items[i].offset = *(size_t *)link->linkdata * sizeof(double);
+				batch->items[i].generation = 0;
+				batch->end = max(batch->end, batch->items[i].offset + sizeof(double));
+			}
+
+			qsort(batch->items, count, sizeof(linkitem_t), batch_compare);
+			first->batch = batch;
 		}
+
+		pos = last;
 	}
-	mutex_unlock(&io_lock);
 }
 
 void link_sort(linklist_t * links)
@@ -401,6 +971,10 @@ void link_sort(linklist_t * links)
 
 	list_sort(&links->inputs, link_compare);
 	list_sort(&links->outputs, link_compare);
+
+	// Compile runs of indexed links on the same array into batches
+	link_batch(&links->inputs, copy_d2D);
+	link_batch(&links->outputs, copy_D2d);
 }
 
 
@@ -458,18 +1032,93 @@ static void copy_x2x(const void * linkdata, const void * from, bool from_isnull,
 {
 	unused(linkdata);
 
+	// Link backings are never written in place, so every hop shares the published handle
+	buffer_t * dup = NULL;
+	if (!from_isnull && (dup = buffer_ref(*(const buffer_t **)from)) == NULL)
+	{
+		// Out of buffer memory (counted by the pool), keep the previous value rather than dropping it
+		return;
+	}
+
 	if (!to_isnull)		buffer_free(*(buffer_t **)to);
-	if (!from_isnull)	*(buffer_t **)to = buffer_dup(*(const buffer_t **)from);
+	if (!from_isnull)	*(buffer_t **)to = dup;
+}
+
+static void copy_a2a(const void * linkdata, const void * from, bool from_isnull, void * to, bool to_isnull)
+{
+	unused(linkdata);
+
+	iobacking_copyarray(to, to_isnull, (from_isnull)? NULL : *(const array_t **)from, true);
+}
+
+static void copy_B2I(const void * linkdata, const void * from, bool from_isnull, void * to, bool to_isnull)
+{
+	unused(linkdata);
+
+	iobacking_convertarray(to, to_isnull, (from_isnull)? NULL : *(const array_t **)from, T_ARRAY_BOOLEAN, T_ARRAY_INTEGER);
+}
+
+static void copy_B2D(const void * linkdata, const void * from, bool from_isnull, void * to, bool to_isnull)
+{
+	unused(linkdata);
+
+	iobacking_convertarray(to, to_isnull, (from_isnull)? NULL : *(const array_t **)from, T_ARRAY_BOOLEAN, T_ARRAY_DOUBLE);
+}
+
+static void copy_I2B(const void * linkdata, const void * from, bool from_isnull, void * to, bool to_isnull)
+{
+	unused(linkdata);
+
+	iobacking_convertarray(to, to_isnull, (from_isnull)? NULL : *(const array_t **)from, T_ARRAY_INTEGER, T_ARRAY_BOOLEAN);
+}
+
+static void copy_I2D(const void * linkdata, const void * from, bool from_isnull, void * to, bool to_isnull)
+{
+	unused(linkdata);
+
+	iobacking_convertarray(to, to_isnull, (from_isnull)? NULL : *(const array_t **)from, T_ARRAY_INTEGER, T_ARRAY_DOUBLE);
+}
+
+static void copy_D2B(const void * linkdata, const void * from, bool from_isnull, void * to, bool to_isnull)
+{
+	unused(linkdata);
+
+	iobacking_convertarray(to, to_isnull, (from_isnull)? NULL : *(const array_t **)from, T_ARRAY_DOUBLE, T_ARRAY_BOOLEAN);
+}
+
+static void copy_D2I(const void * linkdata, const void * from, bool from_isnull, void * to, bool to_isnull)
+{
+	unused(linkdata);
+
+	iobacking_convertarray(to, to_isnull, (from_isnull)? NULL : *(const array_t **)from, T_ARRAY_DOUBLE, T_ARRAY_INTEGER);
 }
 
 static void copy_d2D(const void * linkdata, const void * from, bool from_isnull, void * to, bool to_isnull)
 {
 	if (from_isnull)	return;
-	if (to_isnull)		*(array_t **)to = array_new();
+	if (to_isnull)		*(array_t **)to = buffer_newinline(iobacking_inline(to));
+	if (iobacking_unshare(to) == NULL)	return;
+
+	// Move the array to the pool first when the index is past the inline storage
+	size_t end = ((size_t)*(int *)linkdata + 1) * sizeof(double);
+	if (buffer_isinline(*(array_t **)to) && end > BUFFER_INLINECAPACITY && iobacking_spill(to) == NULL)	return;
+
 	array_writeindex(*(array_t **)to, T_ARRAY_DOUBLE, *(int *)linkdata, from);
 }
 
 
+static void copy_D2d(const void * linkdata, const void * from, bool from_isnull, void * to, bool to_isnull)
+{
+	unused(to_isnull);
+
+	if (from_isnull)	return;
+	if (!array_readindex(*(const array_t **)from, T_ARRAY_DOUBLE, *(size_t *)linkdata, to))
+	{
+		*(double *)to = 0.0;
+	}
+}
+
+
 link_f link_getfunction(const model_linksymbol_t * linksym, char fromsig, char tosig, void ** linkdata)
 {
 	// Sanity check
@@ -506,13 +1155,20 @@ link_f link_getfunction(const model_linksymbol_t * linksym, char fromsig, char t
 	func_match(	T_STRING,			T_STRING,			data_null(),	copy_s2s	);
 
 	// Match boolean array -> ?
-	func_match(	T_ARRAY_BOOLEAN,	T_ARRAY_BOOLEAN,	data_null(),	copy_x2x	);
+	func_match(	T_ARRAY_BOOLEAN,	T_ARRAY_BOOLEAN,	data_null(),	copy_a2a	);
+	func_match(	T_ARRAY_BOOLEAN,	T_ARRAY_INTEGER,	data_null(),	copy_B2I	);
+	func_match(	T_ARRAY_BOOLEAN,	T_ARRAY_DOUBLE,		data_null(),	copy_B2D	);
 
 	// Match integer array -> ?
-	func_match(	T_ARRAY_INTEGER,	T_ARRAY_INTEGER,	data_null(),	copy_x2x	);
+	func_match(	T_ARRAY_INTEGER,	T_ARRAY_INTEGER,	data_null(),	copy_a2a	);
+	func_match(	T_ARRAY_INTEGER,	T_ARRAY_BOOLEAN,	data_null(),	copy_I2B	);
+	func_match(	T_ARRAY_INTEGER,	T_ARRAY_DOUBLE,		data_null(),	copy_I2D	);
 
 	// Match double array -> ?
-	func_match(	T_ARRAY_DOUBLE,		T_ARRAY_DOUBLE,		data_null(),	copy_x2x	);
+	func_match(	T_ARRAY_DOUBLE,		T_ARRAY_DOUBLE,		data_null(),	copy_a2a	);
+	func_match(	T_ARRAY_DOUBLE,		T_DOUBLE,			data_index(),	copy_D2d	);
+	func_match(	T_ARRAY_DOUBLE,		T_ARRAY_BOOLEAN,	data_null(),	copy_D2B	);
+	func_match(	T_ARRAY_DOUBLE,		T_ARRAY_INTEGER,	data_null(),	copy_D2I	);
 
 	// Match buffer -> ?
 	func_match(	T_BUFFER,			T_BUFFER,			data_null(),	copy_x2x	);
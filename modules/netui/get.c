@@ -4,7 +4,7 @@
 #include <kernel.h>
 #include <httpserver.h>
 
-#define KOBJ_DESC_BUFFSIZE		1024
+#define KOBJ_DESC_BUFFSIZE		4096		// Rategroup descriptions carry timing histograms (they trim their block instances to fit)
 
 static void get_calibration_mode(httpconnection_t * conn, httpcontext_t * ctx)
 {
@@ -77,6 +77,11 @@ static void get_objects(httpconnection_t * conn, httpcontext_t * ctx)
 					strcpy(buffer, "{ 'error': 'no data' }");
 					wrote = strlen(buffer);
 				}
+				else if (wrote >= KOBJ_DESC_BUFFSIZE)
+				{
+					strcpy(buffer, "{ 'error': 'description too long' }");
+					wrote = strlen(buffer);
+				}
 
 				string_t parent = string_blank();
 				if (kobj_parent(kobj) != NULL)
@@ -1,6 +1,7 @@
 #include <stdio.h>
 #include <errno.h>
 
+#include <aul/atomic.h>
 #include <aul/list.h>
 #include <aul/stack.h>
 #include <aul/mutex.h>
@@ -42,8 +43,19 @@ static volatile bool stop = false;
 static int dispatch_threads = 1;
 static timerwatcher_t monitor_watcher;
 
+// Packets dropped by service_send since the last monitor run (reported as a count, not per packet)
+static volatile size_t dropped_nopacket = 0;
+static volatile size_t dropped_nomemory = 0;
+
 static bool service_monitor(mainloop_t * loop, uint64_t nanoseconds, void * userdata)
 {
+	size_t nopacket = atomic_xchg(dropped_nopacket, 0);
+	size_t nomemory = atomic_xchg(dropped_nomemory, 0);
+	if (nopacket > 0 || nomemory > 0)
+	{
+		LOG(LOG_WARN, "Dropped %zu service packets (%zu out of free packets, %zu out of buffer memory)", nopacket + nomemory, nopacket, nomemory);
+	}
+
 	mutex_lock(&services_lock);
 	{
 		list_t * pos = NULL;
@@ -128,6 +140,28 @@ static bool service_rundispatch(void * userdata)
 	return false;
 }
 
+static size_t service_reclaim(void * userdata)
+{
+	unused(userdata);
+
+	// The buffer pool is exhausted, evict the oldest queued packet (its clients miss it)
+	// Only try the lock, the pool may be running dry in a thread that already holds it
+	list_t * packet_entry = NULL;
+	if (mutex_trylock(&packets_lock))
+	{
+		packet_entry = stack_pop(&packets);
+		if (packet_entry != NULL)
+		{
+			packet_t * packet = list_entry(packet_entry, packet_t, packet_list);
+			buffer_free(packet->buffer);
+			stack_push(&packets_free, &packet->packet_list);
+		}
+		mutex_unlock(&packets_lock);
+	}
+
+	return (packet_entry != NULL)? 1 : 0;
+}
+
 static bool service_stopdispatch(void * userdata)
 {
 	stop = true;
@@ -191,7 +225,7 @@ void service_send(service_t * service, int64_t microtimestamp, const buffer_t *
 
 	if (entry == NULL)
 	{
-		LOG(LOG_WARN, "Out of free service packets!");
+		atomic_inc(dropped_nopacket);
 		return;
 	}
 
@@ -202,6 +236,19 @@ void service_send(service_t * service, int64_t microtimestamp, const buffer_t *
 	packet->timestamp = microtimestamp;
 	packet->buffer = buffer_dup(buffer);
 
+	if (packet->buffer == NULL)
+	{
+		// Buffer pool exhausted, drop this packet
+		mutex_lock(&packets_lock);
+		{
+			stack_push(&packets_free, &packet->packet_list);
+		}
+		mutex_unlock(&packets_lock);
+
+		atomic_inc(dropped_nomemory);
+		return;
+	}
+
 	// Add the packet to the consumer-list and notify the dispatch threads
 	mutex_lock(&packets_lock);
 	{
@@ -360,19 +407,36 @@ void service_listxml(buffer_t * buffer)
 		}
 	}
 
-	size_t bufferlen = 0;
+	bufferpos_t pos;
+	bufferpos_new(&pos, buffer, 0);
 
 	void append(const char * fmt, ...)
 	{
-		string_t str = string_blank();
-
 		va_list args;
 		va_start(args, fmt);
-		string_vset(&str, fmt, args);
+		size_t length = vsnprintf(NULL, 0, fmt, args);
 		va_end(args);
 
-		buffer_write(buffer, str.string, bufferlen, str.length);
-		bufferlen += str.length;
+		// Format straight into the buffer page when it fits (including the terminating null)
+		char * span = buffer_reserve(&pos, length + 1);
+		if (span != NULL)
+		{
+			va_start(args, fmt);
+			vsnprintf(span, length + 1, fmt, args);
+			va_end(args);
+
+			buffer_commit(&pos, length);
+		}
+		else
+		{
+			string_t str = string_blank();
+
+			va_start(args, fmt);
+			string_vset(&str, fmt, args);
+			va_end(args);
+
+			bufferpos_write(&pos, str.string, str.length);
+		}
 	}
 
 	append("<servicelist>");
@@ -446,6 +510,12 @@ static bool service_init()
 		}
 	}
 
+	// Let the buffer pool evict queued packets when it runs out of memory
+	if (!buffer_addreclaimer(service_reclaim, NULL))
+	{
+		LOG(LOG_WARN, "Could not register service packet reclaimer with the buffer pool");
+	}
+
 	// Initialize the dispatch threads
 	{
 		if (dispatch_threads <= 0)
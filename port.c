@@ -1,10 +1,17 @@
 #include <errno.h>
 
+#include <aul/hashtable.h>
+#include <aul/mutex.h>
+
 #include <maxmodel/model.h>
 
 #include <kernel.h>
 #include <kernel-priv.h>
 
+extern hashtable_t portkeys;
+extern mutex_t portkeys_mutex;
+
+static size_t portkeys_slots = 0;		// Slots handed out so far (under portkeys_mutex)
 
 static void port_sort(portlist_t * ports)
 {
@@ -53,6 +60,7 @@ bool port_add(portlist_t * ports, meta_iotype_t type, const char * name, iobacki
 	memset(port, 0, sizeof(port_t));
 	port->type = type;
 	strcpy(port->name, name);
+	port->key = port_intern(name);
 	port->backing = backing;
 
 	list_add(ports, &port->port_list);
@@ -104,6 +112,126 @@ port_t * port_lookup(portlist_t * ports, meta_iotype_t type, const char * name)
 	return NULL;
 }
 
+const portkey_t * port_intern(const char * name)
+{
+	// Sanity check
+	{
+		if unlikely(name == NULL || strlen(name) >= MODEL_SIZE_NAME)
+		{
+			return NULL;
+		}
+	}
+
+	portkey_t * key = NULL;
+
+	mutex_lock(&portkeys_mutex);
+	{
+		hashentry_t * entry = hashtable_get(&portkeys, name);
+		if (entry != NULL)
+		{
+			key = hashtable_entry(entry, portkey_t, global_entry);
+		}
+		else
+		{
+			// Keys live for the life of the kernel so handles never dangle
+			key = malloc(sizeof(portkey_t));
+			memset(key, 0, sizeof(portkey_t));
+			strcpy(key->name, name);
+			key->slot = portkeys_slots++;
+			hashtable_put(&portkeys, key->name, &key->global_entry);
+		}
+	}
+	mutex_unlock(&portkeys_mutex);
+
+	return key;
+}
+
+bool port_makeindex(portlist_t * ports, meta_iotype_t type, portindex_t * index, exception_t ** err)
+{
+	// Sanity check
+	{
+		if unlikely(exception_check(err))
+		{
+			return false;
+		}
+
+		if unlikely(ports == NULL || index == NULL)
+		{
+			exception_set(err, EINVAL, "Bad arguments!");
+			return false;
+		}
+	}
+
+	memset(index, 0, sizeof(portindex_t));
+
+	// Cover the range of slots of this type's ports
+	size_t first = SIZE_MAX, last = 0;
+	list_t * pos = NULL;
+	list_foreach(pos, ports)
+	{
+		port_t * port = list_entry(pos, port_t, port_list);
+		if (port->type == type && port->key != NULL)
+		{
+			first = min(first, port->key->slot);
+			last = max(last, port->key->slot);
+		}
+	}
+
+	if (first == SIZE_MAX)
+	{
+		// No ports of this type, every lookup misses
+		return true;
+	}
+
+	index->base = first;
+	index->length = last - first + 1;
+	index->ports = malloc(sizeof(port_t *) * index->length);
+	memset(index->ports, 0, sizeof(port_t *) * index->length);
+
+	list_foreach(pos, ports)
+	{
+		port_t * port = list_entry(pos, port_t, port_list);
+		if (port->type == type && port->key != NULL)
+		{
+			index->ports[port->key->slot - first] = port;
+		}
+	}
+
+	return true;
+}
+
+void port_destroyindex(portindex_t * index)
+{
+	// Sanity check
+	{
+		if unlikely(index == NULL)
+		{
+			return;
+		}
+	}
+
+	free(index->ports);
+	memset(index, 0, sizeof(portindex_t));
+}
+
+void port_markseen(portlist_t * ports)
+{
+	// Sanity check
+	{
+		if unlikely(ports == NULL)
+		{
+			return;
+		}
+	}
+
+	list_t * pos = NULL;
+	list_foreach(pos, ports)
+	{
+		port_t * port = list_entry(pos, port_t, port_list);
+		port->seen = iobacking_generation(port->backing);
+	}
+}
+
 bool port_makeblockports(const block_t * block, portlist_t * ports, exception_t ** err)
 {
 	// Sanity check
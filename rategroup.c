@@ -3,14 +3,45 @@
 
 #include <aul/exception.h>
 #include <aul/iterator.h>
+#include <aul/mutex.h>
 
 #include <array.h>
 #include <buffer.h>
 #include <kernel.h>
 #include <kernel-priv.h>
 
+#define RATEGROUP_DESCTAIL		64			// Room kept for closing the description when block instances are left out
+
 extern list_t rategroups;
 
+struct __rategroupteam_t
+{
+	// Block instances of the current update handed out to the rategroup thread and its workers
+	mutex_t mutex;
+	cond_t wakeup;						// Broadcast when block instances become ready, and when the update is done
+	size_t remaining;					// Block instances of the current update that haven't finished
+	kthread_t ** workers;
+	size_t ready_length;
+	size_t ready[0];					// Plan indexes that can run now (a stack, the plan has at most one entry per block instance)
+};
+
+typedef struct
+{
+	// Each worker thread waits on its own trigger for ready block instances
+	trigger_t trigger;
+	rategroup_t * rg;
+	bool stop;
+} rategroupworker_t;
+
+static threadlocal rategroup_blockinst_t * rategroup_active = NULL;		// Block instance being updated by this thread
+
+static inline uint64_t rategroup_nanos()
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t)now.tv_sec * NANOS_PER_SECOND + now.tv_nsec;
+}
+
 static ssize_t rategroup_desc(const kobject_t * object, char * buffer, size_t length)
 {
 	const rategroup_t * rg = (const rategroup_t *)object;
@@ -23,13 +54,68 @@ static ssize_t rategroup_desc(const kobject_t * object, char * buffer, size_t le
 		string_append(&ids, "%s'%#x'", (ids.length == 0)? "" : ", ", kobj_id(kobj_cast(rg_blockinst->blockinst)));
 	}
 
-	return snprintf(buffer, length, "{ 'name': '%s', 'priority': %d, 'trigger_id': '%#x', 'blockinstance_ids': [ %s ] }", rg->name, rg->priority, kobj_id(kobj_cast(trigger_cast(rg->trigger))), ids.string);
+	// The timing section is too long for a string_t, write it straight into the buffer
+	size_t wrote = 0;
+	#define desc_append(fmt, ...)		(wrote += snprintf(&buffer[min(wrote, length)], length - min(wrote, length), fmt, ## __VA_ARGS__))
+	#define desc_histogram(h)			(wrote += histogram_desc((h), &buffer[min(wrote, length)], length - min(wrote, length)))
+
+	desc_append("{ 'name': '%s', 'priority': %d, 'sched': '%s', 'workers': %zu, 'trigger_id': '%#x', 'blockinstance_ids': [ %s ], ", rg->name, rg->priority, (rg->sched == model_scheddeadline)? "deadline" : "roundrobin", (rg->team == NULL)? 0 : rg->workers, kobj_id(kobj_cast(trigger_cast(rg->trigger))), ids.string);
+	desc_append("'timing': { 'latency': ");				desc_histogram(&rg->latency);
+	desc_append(", 'execution': ");						desc_histogram(&rg->execution);
+	desc_append(", 'overrun': ");						desc_histogram(&rg->overrun);
+	desc_append(", 'blockinstances': [ ");
+
+	// Only a p99/max summary per block instance (see rategroup_blockinsttiming for the rest), and stop
+	// before the buffer fills up so a big rategroup loses its tail rather than the whole description
+	size_t shown = 0, omitted = 0;
+	list_foreach(pos, &rg->blockinsts)
+	{
+		rategroup_blockinst_t * rg_blockinst = list_entry(pos, rategroup_blockinst_t, rategroup_list);
+
+		char entry[128];
+		size_t entry_length = snprintf(entry, sizeof(entry), "%s{ 'id': '%#x', 'p99': %" PRIu64 ", 'max': %" PRIu64 " }", (shown == 0)? "" : ", ", kobj_id(kobj_cast(rg_blockinst->blockinst)), histogram_percentile(&rg_blockinst->execution, 99.0), histogram_max(&rg_blockinst->execution));
+		if (omitted > 0 || wrote + entry_length + RATEGROUP_DESCTAIL >= length)
+		{
+			omitted += 1;
+			continue;
+		}
+
+		desc_append("%s", entry);
+		shown += 1;
+	}
+
+	if (omitted > 0)
+	{
+		desc_append(" ], 'blockinstances_omitted': %zu } }", omitted);
+	}
+	else
+	{
+		desc_append(" ] } }");
+	}
+
+	#undef desc_append
+	#undef desc_histogram
+	return wrote;
 }
 
 static void rategroup_destroy(kobject_t * object)
 {
 	rategroup_t * rg = (rategroup_t *)object;
 
+	// Stop the workers before anything they run goes away
+	if (rg->team != NULL)
+	{
+		for (size_t i = 0; i < rg->workers; i++)
+		{
+			kobj_destroy(kobj_cast(rg->team->workers[i]));
+		}
+
+		cond_destroy(&rg->team->wakeup);
+		mutex_destroy(&rg->team->mutex);
+		free(rg->team->workers);
+		free(rg->team);
+	}
+
 	// Destroy the rategroup block instances
 	{
 		list_t * pos = NULL, * n = NULL;
@@ -38,23 +124,172 @@ static void rategroup_destroy(kobject_t * object)
 			rategroup_blockinst_t * rg_blockinst = list_entry(pos, rategroup_blockinst_t, rategroup_list);
 			list_remove(pos);
 
+			port_destroyindex(&rg_blockinst->inputs_index);
+			port_destroyindex(&rg_blockinst->outputs_index);
 			port_destroy(&rg_blockinst->ports);
+			free(rg_blockinst->inputs);
+			free(rg_blockinst->outputs);
+			free(rg_blockinst->next);
 			free(rg_blockinst);
 		}
 	}
 
+	free(rg->plan);
+	free(rg->cpus);
 	free(rg->name);
 }
 
-static inline rategroup_t * rategroup_getrunning()
+static void rategroup_admit(rategroup_t * rg)
 {
-	kthread_t * self = kthread_self();
-	if unlikely(self == NULL)
+	// Budget the p99.9 update (plus a margin) rather than the worst one, a single outlier in the warmup
+	// would otherwise reserve CPU forever. The kernel throttles the rare update that runs past it
+	trigger_clock_t * clk = trigger_varclock_clock(rg->trigger);
+	uint64_t runtime = max((uint64_t)(histogram_percentile(&rg->execution, DEADLINE_PERCENTILE) * DEADLINE_MARGIN), (uint64_t)DEADLINE_MINRUNTIME);
+	runtime = min(runtime, clk->interval_nsec);
+
+	exception_t * e = NULL;
+	if (!trigger_setdeadline(clk, runtime, &e))
 	{
-		return NULL;
+		LOGK(LOG_WARN, "Rategroup %s was not admitted to SCHED_DEADLINE, staying on SCHED_RR: %s", rg->name, exception_message(e));
+		exception_free(e);
+
+		rg->sched = model_schedroundrobin;
+		return;
+	}
+
+	LOGK(LOG_INFO, "Rategroup %s runs under SCHED_DEADLINE (runtime %" PRIu64 " ns every %" PRIu64 " ns)", rg->name, runtime, clk->interval_nsec);
+}
+
+static inline void rategroup_update(rategroup_blockinst_t * rg_blockinst)
+{
+	// Handle all the input links
+	link_runplan(rg_blockinst->inputs);
+
+	// Set up the active cache
+	rategroup_active = rg_blockinst;
+
+	// Call the onupdate function
+	if (rg_blockinst->onupdate != NULL)
+	{
+		blockinst_act(rg_blockinst->blockinst, rg_blockinst->onupdate);
+	}
+
+	// Clear the active cache
+	rategroup_active = NULL;
+
+	// Everything the block could see this update is now old (for input_changed)
+	port_markseen(&rg_blockinst->ports);
+
+	// Handle all the output links
+	link_runplan(rg_blockinst->outputs);
+}
+
+static inline int rategroup_teamlock(rategroupteam_t * team)
+{
+	// The team mutex is only ever held with cancellation off (cond_wait is a cancellation point), so a
+	// cancelled thread can't leave it locked or the team half updated. Returns the previous cancel state
+	int cancelstate = PTHREAD_CANCEL_ENABLE;
+	pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, &cancelstate);
+	mutex_lock(&team->mutex);
+	return cancelstate;
+}
+
+static inline void rategroup_teamunlock(rategroupteam_t * team, int cancelstate)
+{
+	mutex_unlock(&team->mutex);
+	pthread_setcancelstate(cancelstate, NULL);
+}
+
+static void rategroup_teamwork(rategroup_t * rg, int cancelstate)
+{
+	// Run ready block instances until there are none left, called with the team mutex held (see rategroup_teamlock)
+	rategroupteam_t * team = rg->team;
+	while (team->ready_length > 0)
+	{
+		rategroup_blockinst_t * rg_blockinst = rg->plan[team->ready[--team->ready_length]];
+
+		// The block runs unlocked with the caller's cancel state
+		rategroup_teamunlock(team, cancelstate);
+		{
+			uint64_t start = rategroup_nanos();
+			rategroup_update(rg_blockinst);
+			histogram_record(&rg_blockinst->execution, rategroup_nanos() - start);
+		}
+		rategroup_teamlock(team);
+
+		// Release the block instances that were only waiting on this one
+		size_t released = 0;
+		for (size_t i = 0; i < rg_blockinst->next_length; i++)
+		{
+			size_t next = rg_blockinst->next[i];
+			if ((rg->plan[next]->pending -= 1) == 0)
+			{
+				team->ready[team->ready_length++] = next;
+				released += 1;
+			}
+		}
+
+		team->remaining -= 1;
+		if (released > 1 || team->remaining == 0)
+		{
+			// This thread takes one of them, wake the others for the rest (or the rategroup thread for the end of the update)
+			cond_broadcast(&team->wakeup);
+		}
+	}
+}
+
+static bool rategroup_waitwork(trigger_t * trigger)
+{
+	rategroupworker_t * worker = (rategroupworker_t *)trigger;
+	rategroupteam_t * team = worker->rg->team;
+
+	bool triggered = false;
+	int cancelstate = rategroup_teamlock(team);
+	{
+		// Not cancellable here, rategroup_stopworker wakes us up instead
+		while (team->ready_length == 0 && !worker->stop)
+		{
+			cond_wait(&team->wakeup, &team->mutex, 0);
+		}
+
+		triggered = !worker->stop;
+	}
+	rategroup_teamunlock(team, cancelstate);
+
+	return triggered;
+}
+
+static bool rategroup_runworker(kthread_t * thread, kobject_t * object)
+{
+	unused(object);
+
+	rategroupworker_t * worker = (rategroupworker_t *)kthread_trigger(thread);
+	rategroup_t * rg = worker->rg;
+
+	int cancelstate = rategroup_teamlock(rg->team);
+	{
+		rategroup_teamwork(rg, cancelstate);
 	}
+	rategroup_teamunlock(rg->team, cancelstate);
 
-	return (rategroup_t *)kthread_object(self);
+	return true;
+}
+
+static bool rategroup_stopworker(kthread_t * thread, kobject_t * object)
+{
+	unused(object);
+
+	rategroupworker_t * worker = (rategroupworker_t *)kthread_trigger(thread);
+	rategroupteam_t * team = worker->rg->team;
+
+	int cancelstate = rategroup_teamlock(team);
+	{
+		worker->stop = true;
+		cond_broadcast(&team->wakeup);
+	}
+	rategroup_teamunlock(team, cancelstate);
+
+	return true;
 }
 
 static bool rategroup_run(kthread_t * thread, kobject_t * object)
@@ -62,32 +297,72 @@ static bool rategroup_run(kthread_t * thread, kobject_t * object)
 	unused(thread);
 
 	rategroup_t * rg = (rategroup_t *)object;
+	const trigger_clock_t * clk = trigger_varclock_clock(rg->trigger);
 
-	list_t * pos = NULL;
-	list_foreach(pos, &rg->blockinsts)
-	{
-		rategroup_blockinst_t * rg_blockinst = list_entry(pos, rategroup_blockinst_t, rategroup_list);
+	uint64_t start = rategroup_nanos(), mark = start;
+	histogram_record(&rg->latency, (start > clk->scheduled_nsec)? start - clk->scheduled_nsec : 0);
 
-		// Handle all the input links
-		link_doinputs(&rg_blockinst->ports, &rg_blockinst->blockinst->links);
+	if (rg->team == NULL)
+	{
+		for (size_t i = 0; i < rg->plan_length; i++)
+		{
+			rategroup_blockinst_t * rg_blockinst = rg->plan[i];
+			rategroup_update(rg_blockinst);
 
-		// Set up the active cache
-		rg->active = rg_blockinst;
+			// One clock read per block instance, its end is the start of the next one
+			uint64_t now = rategroup_nanos();
+			histogram_record(&rg_blockinst->execution, now - mark);
+			mark = now;
+		}
+	}
+	else
+	{
+		rategroupteam_t * team = rg->team;
 
-		// Call the onupdate function
+		int cancelstate = rategroup_teamlock(team);
 		{
-			blockact_f onupdate = block_cbupdate(blockinst_block(rg_blockinst->blockinst));
-			if (onupdate != NULL)
+			// Start with the block instances that don't wait on any other (pushed backwards so they come off the stack in plan order)
+			team->remaining = rg->plan_length;
+			for (size_t i = rg->plan_length; i > 0; i--)
 			{
-				blockinst_act(rg_blockinst->blockinst, onupdate);
+				rategroup_blockinst_t * rg_blockinst = rg->plan[i - 1];
+				rg_blockinst->pending = rg_blockinst->waitfor;
+				if (rg_blockinst->waitfor == 0)
+				{
+					team->ready[team->ready_length++] = i - 1;
+				}
+			}
+
+			cond_broadcast(&team->wakeup);
+
+			// Work alongside the workers, the update is done once every block instance has run
+			while (true)
+			{
+				rategroup_teamwork(rg, cancelstate);
+				if (team->remaining == 0)
+				{
+					break;
+				}
+
+				cond_wait(&team->wakeup, &team->mutex, 0);
 			}
 		}
+		rategroup_teamunlock(team, cancelstate);
 
-		// Clear the active cache
-		rg->active = NULL;
+		mark = rategroup_nanos();
+	}
+
+	uint64_t execution = mark - start;
+	histogram_record(&rg->execution, execution);
+	if (clk->interval_nsec != 0 && execution > clk->interval_nsec)
+	{
+		histogram_record(&rg->overrun, execution - clk->interval_nsec);
+	}
 
-		// Handle all the output links
-		link_dooutputs(&rg_blockinst->ports, &rg_blockinst->blockinst->links);
+	if unlikely(rg->sched == model_scheddeadline && clk->runtime_nsec == 0 && !clk->refused && histogram_count(&rg->execution) >= DEADLINE_WARMUP)
+	{
+		// Measured long enough on SCHED_RR, switch this thread over
+		rategroup_admit(rg);
 	}
 
 	return true;
@@ -112,7 +387,16 @@ rategroup_t * rategroup_new(const model_linkable_t * linkable, exception_t ** er
 	const char * name = NULL;
 	int priority = 0;
 	double hertz = 0;
+	model_overrun_t overrun = model_overrunskip;
+	const char * cpus = NULL;
 	model_getrategroup(linkable, &name, &priority, &hertz);
+	model_getrategroupoverrun(linkable, &overrun);
+	model_getrategroupcpus(linkable, &cpus);
+
+	model_schedmode_t sched = model_schedroundrobin;
+	size_t workers = 0;
+	model_getrategroupsched(linkable, &sched);
+	model_getrategroupworkers(linkable, &workers);
 
 	LOGK(LOG_DEBUG, "Creating rategroup %s with priority %d and update rate of %f Hz", name, priority, hertz);
 
@@ -123,9 +407,14 @@ rategroup_t * rategroup_new(const model_linkable_t * linkable, exception_t ** er
 		return NULL;
 	}
 
+	trigger_setoverrun(trigger_varclock_clock(trigger), overrun);
+
 	rategroup_t * rg = kobj_new("Rategroup", name, rategroup_desc, rategroup_destroy, sizeof(rategroup_t));
 	rg->name = strdup(name);
 	rg->priority = priority;
+	rg->cpus = (cpus == NULL || strlen(cpus) == 0)? NULL : strdup(cpus);
+	rg->sched = sched;
+	rg->workers = workers;
 	rg->trigger = trigger;
 	list_init(&rg->blockinsts);
 
@@ -160,6 +449,12 @@ bool rategroup_addblockinst(rategroup_t * rategroup, blockinst_t * blockinst, ex
 		return false;
 	}
 
+	// Resolve the handles once, input()/output() then index straight into these
+	if (!port_makeindex(&backing->ports, meta_input, &backing->inputs_index, err) || !port_makeindex(&backing->ports, meta_output, &backing->outputs_index, err))
+	{
+		return false;
+	}
+
 	// Add the backing to the rategroup
 	list_add(&rategroup->blockinsts, &backing->rategroup_list);
 
@@ -182,6 +477,111 @@ bool rategroup_schedule(rategroup_t * rategroup, exception_t ** err)
 		}
 	}
 
+	// Compile the execution plan now that all the links are built
+	{
+		size_t length = 0;
+		list_t * pos = NULL;
+		list_foreach(pos, &rategroup->blockinsts)
+		{
+			length += 1;
+		}
+
+		rategroup->plan = malloc(sizeof(rategroup_blockinst_t *) * length);
+		rategroup->plan_length = 0;
+
+		list_foreach(pos, &rategroup->blockinsts)
+		{
+			rategroup_blockinst_t * rg_blockinst = list_entry(pos, rategroup_blockinst_t, rategroup_list);
+			blockinst_t * blockinst = rg_blockinst->blockinst;
+
+			rg_blockinst->onupdate = block_cbupdate(blockinst_block(blockinst));
+			rg_blockinst->inputs = link_compile(&rg_blockinst->ports, &blockinst->links, meta_input, err);
+			rg_blockinst->outputs = link_compile(&rg_blockinst->ports, &blockinst->links, meta_output, err);
+			if (rg_blockinst->inputs == NULL || rg_blockinst->outputs == NULL || exception_check(err))
+			{
+				return false;
+			}
+
+			rategroup->plan[rategroup->plan_length++] = rg_blockinst;
+		}
+	}
+
+	// Work out which block instances have to keep their plan order, the rest can run on the workers at the same time
+	if (rategroup->workers > 0 && rategroup->plan_length > 1)
+	{
+		bool depends(size_t before, size_t after)
+		{
+			blockinst_t * a = rategroup->plan[before]->blockinst, * b = rategroup->plan[after]->blockinst;
+
+			// Linked either way (a later block instance feeding an earlier one still has to see last update's value),
+			// or from the same module (its blocks share the module globals)
+			return link_isconnected(blockinst_links(a), blockinst_links(b)) || link_isconnected(blockinst_links(b), blockinst_links(a)) || blockinst_block(a)->module == blockinst_block(b)->module;
+		}
+
+		bool serial = true;
+		for (size_t i = 0; i < rategroup->plan_length; i++)
+		{
+			rategroup_blockinst_t * rg_blockinst = rategroup->plan[i];
+			rg_blockinst->next = malloc(sizeof(size_t) * rategroup->plan_length);
+
+			for (size_t j = i + 1; j < rategroup->plan_length; j++)
+			{
+				if (depends(i, j))
+				{
+					rg_blockinst->next[rg_blockinst->next_length++] = j;
+					rategroup->plan[j]->waitfor += 1;
+				}
+				else if (j == i + 1)
+				{
+					serial = false;
+				}
+			}
+		}
+
+		if (serial)
+		{
+			// Every block instance waits on the one before it, workers would only add hand-offs
+			LOGK(LOG_INFO, "Rategroup %s has no independent block instances, running them in order without workers", rategroup->name);
+		}
+		else
+		{
+			rategroupteam_t * team = malloc(sizeof(rategroupteam_t) + sizeof(size_t) * rategroup->plan_length);
+			memset(team, 0, sizeof(rategroupteam_t));
+			mutex_init(&team->mutex, M_NORMAL);
+			cond_init(&team->wakeup);
+			team->workers = malloc(sizeof(kthread_t *) * rategroup->workers);
+			memset(team->workers, 0, sizeof(kthread_t *) * rategroup->workers);
+			rategroup->team = team;
+
+			for (size_t i = 0; i < rategroup->workers; i++)
+			{
+				string_t name = string_new("%s worker %zu", rategroup->name, i);
+				rategroupworker_t * worker = trigger_new(name.string, NULL, NULL, rategroup_waitwork, sizeof(rategroupworker_t));
+				worker->rg = rategroup;
+
+				kthread_t * thread = kthread_new(name.string, rategroup->priority, trigger_cast(worker), NULL, rategroup_runworker, rategroup_stopworker, err);
+				if (thread == NULL || exception_check(err))
+				{
+					return false;
+				}
+
+				// Workers go away with the rategroup, and stand in for its thread (same rules for the buffer pool)
+				kobj_makechild(kobj_cast(rategroup), kobj_cast(thread));
+				team->workers[i] = thread;
+				thread->realtime = true;
+
+				if (rategroup->cpus != NULL && !kthread_pin(thread, rategroup->cpus, err))
+				{
+					return false;
+				}
+
+				kthread_schedule(thread);
+			}
+
+			LOGK(LOG_DEBUG, "Rategroup %s runs its block instances on %zu workers", rategroup->name, rategroup->workers);
+		}
+	}
+
 	string_t name = string_new("%s thread", rategroup->name);
 	kthread_t * thread = kthread_new(name.string, rategroup->priority, trigger_cast(rategroup->trigger), kobj_cast(rategroup), rategroup_run, NULL, err);
 	if (thread == NULL || exception_check(err))
@@ -189,6 +589,14 @@ bool rategroup_schedule(rategroup_t * rategroup, exception_t ** err)
 		return false;
 	}
 
+	// Rategroups can't block on an exhausted buffer pool, let them use the emergency reserve
+	thread->realtime = true;
+
+	if (rategroup->cpus != NULL && !kthread_pin(thread, rategroup->cpus, err))
+	{
+		return false;
+	}
+
 	kthread_schedule(thread);
 	return true;
 }
@@ -204,17 +612,10 @@ const void * rategroup_input(const char * name)
 	}
 
 
-	rategroup_t * rg = rategroup_getrunning();
-	if unlikely(rg == NULL)
-	{
-		LOGK(LOG_WARN, "Could not get executing rategroup. Invalid operating context!");
-		return NULL;
-	}
-
-	rategroup_blockinst_t * rg_blockinst = rg->active;
+	rategroup_blockinst_t * rg_blockinst = rategroup_active;
 	if unlikely(rg_blockinst == NULL)
 	{
-		LOGK(LOG_WARN, "Rategroup is not currently executing a block instance!");
+		LOGK(LOG_WARN, "Not executing a rategroup block instance. Invalid operating context!");
 		return NULL;
 	}
 
@@ -245,26 +646,222 @@ void rategroup_output(const char * name, const void * output)
 	}
 
 
-	rategroup_t * rg = rategroup_getrunning();
-	if unlikely(rg == NULL)
+	rategroup_blockinst_t * rg_blockinst = rategroup_active;
+	if unlikely(rg_blockinst == NULL)
 	{
-		LOGK(LOG_WARN, "Could not get executing rategroup. Invalid operating context!");
+		LOGK(LOG_WARN, "Not executing a rategroup block instance. Invalid operating context!");
 		return;
 	}
 
-	rategroup_blockinst_t * rg_blockinst = rg->active;
+	port_t * port = port_lookup(&rg_blockinst->ports, meta_output, name);
+	if unlikely(port == NULL)
+	{
+		LOGK(LOG_WARN, "Could not find output '%s' in block instance!", name);
+		return;
+	}
+
+	iobacking_copy(port_iobacking(port), output);
+}
+
+static portkey_t rategroup_badport = { .name = "", .slot = SIZE_MAX, .warned = true };		// Handle for names that can't be a port, never matches
+
+static void rategroup_missingport(porthandle_t handle, const char * what)
+{
+	// Blocks ask for their ports every update, only warn the first time a name isn't found
+	portkey_t * key = (portkey_t *)handle;
+	if (!key->warned && atomic_cas(key->warned, false, true))
+	{
+		LOGK(LOG_WARN, "Could not find %s '%s' in block instance!", what, key->name);
+	}
+}
+
+porthandle_t rategroup_porthandle(const char * name)
+{
+	// Sanity check
+	{
+		if unlikely(name == NULL)
+		{
+			return NULL;
+		}
+	}
+
+	// The block's own ports are interned when its instance is added to a rategroup, so this is a lookup
+	// (the input()/output() macros cache the result, unknown names still get a handle so they aren't looked up again)
+	const portkey_t * key = port_intern(name);
+	if unlikely(key == NULL)
+	{
+		LOGK(LOG_WARN, "Could not create handle for port '%s'!", name);
+		return &rategroup_badport;
+	}
+
+	return key;
+}
+
+const void * rategroup_input_h(porthandle_t handle)
+{
+	// Sanity check
+	{
+		if unlikely(handle == NULL)
+		{
+			return NULL;
+		}
+	}
+
+
+	rategroup_blockinst_t * rg_blockinst = rategroup_active;
+	if unlikely(rg_blockinst == NULL)
+	{
+		LOGK(LOG_WARN, "Not executing a rategroup block instance. Invalid operating context!");
+		return NULL;
+	}
+
+	port_t * port = port_lookupindex(&rg_blockinst->inputs_index, handle);
+	if unlikely(port == NULL)
+	{
+		rategroup_missingport(handle, "input");
+		return NULL;
+	}
+
+	iobacking_t * backing = port_iobacking(port);
+	if (iobacking_isnull(backing))
+	{
+		return NULL;
+	}
+
+	return iobacking_data(backing);
+}
+
+void rategroup_output_h(porthandle_t handle, const void * output)
+{
+	// Sanity check
+	{
+		if unlikely(handle == NULL)
+		{
+			return;
+		}
+	}
+
+
+	rategroup_blockinst_t * rg_blockinst = rategroup_active;
 	if unlikely(rg_blockinst == NULL)
 	{
-		LOGK(LOG_WARN, "Rategroup is not currently executing a block instance!");
+		LOGK(LOG_WARN, "Not executing a rategroup block instance. Invalid operating context!");
 		return;
 	}
 
-	port_t * port = port_lookup(&rg_blockinst->ports, meta_output, name);
+	port_t * port = port_lookupindex(&rg_blockinst->outputs_index, handle);
 	if unlikely(port == NULL)
 	{
-		LOGK(LOG_WARN, "Could not find output '%s' in block instance!", name);
+		rategroup_missingport(handle, "output");
 		return;
 	}
 
 	iobacking_copy(port_iobacking(port), output);
 }
+
+bool rategroup_inputchanged_h(porthandle_t handle)
+{
+	// Sanity check
+	{
+		if unlikely(handle == NULL)
+		{
+			return false;
+		}
+	}
+
+
+	rategroup_blockinst_t * rg_blockinst = rategroup_active;
+	if unlikely(rg_blockinst == NULL)
+	{
+		LOGK(LOG_WARN, "Not executing a rategroup block instance. Invalid operating context!");
+		return false;
+	}
+
+	port_t * port = port_lookupindex(&rg_blockinst->inputs_index, handle);
+	if unlikely(port == NULL)
+	{
+		rategroup_missingport(handle, "input");
+		return false;
+	}
+
+	return port_changed(port);
+}
+
+static rategroup_t * rategroup_lookup(const char * name)
+{
+	list_t * pos = NULL;
+	list_foreach(pos, &rategroups)
+	{
+		rategroup_t * rg = list_entry(pos, rategroup_t, global_list);
+		if (strcmp(rg->name, name) == 0)
+		{
+			return rg;
+		}
+	}
+
+	return NULL;
+}
+
+const char * rategroup_timing(const char * name)
+{
+	// Sanity check
+	{
+		if unlikely(name == NULL)
+		{
+			return "";
+		}
+	}
+
+	rategroup_t * rg = rategroup_lookup(name);
+	if (rg == NULL)
+	{
+		return "";
+	}
+
+	// Find the block instance with the worst typical case
+	const char * slowest = "";
+	uint64_t slowest_p99 = 0;
+	for (size_t i = 0; i < rg->plan_length; i++)
+	{
+		uint64_t p99 = histogram_percentile(&rg->plan[i]->execution, 99.0);
+		if (p99 >= slowest_p99)
+		{
+			slowest = rg->plan[i]->blockinst->name;
+			slowest_p99 = p99;
+		}
+	}
+
+	// Keep it short, syscall returns have to fit in SYSCALL_BUFFERMAX (use rategroup_blockinsttiming for the details)
+	static threadlocal char info[SYSCALL_BUFFERMAX];
+	snprintf(info, sizeof(info), "{ 'latency_p99': %" PRIu64 ", 'latency_max': %" PRIu64 ", 'execution_p99': %" PRIu64 ", 'execution_max': %" PRIu64 ", 'overruns': %" PRIu64 ", 'overrun_max': %" PRIu64 ", 'slowest': '%s' }", histogram_percentile(&rg->latency, 99.0), histogram_max(&rg->latency), histogram_percentile(&rg->execution, 99.0), histogram_max(&rg->execution), histogram_count(&rg->overrun), histogram_max(&rg->overrun), slowest);
+	return info;
+}
+
+const char * rategroup_blockinsttiming(const char * name, const char * blockinst_name)
+{
+	// Sanity check
+	{
+		if unlikely(name == NULL || blockinst_name == NULL)
+		{
+			return "";
+		}
+	}
+
+	rategroup_t * rg = rategroup_lookup(name);
+	if (rg == NULL)
+	{
+		return "";
+	}
+
+	for (size_t i = 0; i < rg->plan_length; i++)
+	{
+		if (strcmp(rg->plan[i]->blockinst->name, blockinst_name) == 0)
+		{
+			static threadlocal char info[SYSCALL_BUFFERMAX];
+			histogram_desc(&rg->plan[i]->execution, info, sizeof(info));
+			return info;
+		}
+	}
+
+	return "";
+}
@@ -86,9 +86,23 @@ ssize_t vserialize_2buffer(buffer_t * buffer, exception_t ** err, const char * s
 {
 	ssize_t wrote = 0;
 
+	bufferpos_t pos;
+	bufferpos_new(&pos, buffer, 0);
+
 	void copy(const void * ptr, size_t s)
 	{
-		buffer_write(buffer, ptr, wrote, s);
+		void * span = buffer_reserve(&pos, s);
+		if (span != NULL)
+		{
+			memcpy(span, ptr, s);
+			buffer_commit(&pos, s);
+		}
+		else
+		{
+			// Value spans a page boundary
+			bufferpos_write(&pos, ptr, s);
+		}
+
 		wrote += s;
 	}
 
@@ -153,9 +167,23 @@ ssize_t aserialize_2buffer(buffer_t * buffer, exception_t ** err, const char * s
 	size_t index = 0;
 	ssize_t wrote = 0;
 
+	bufferpos_t pos;
+	bufferpos_new(&pos, buffer, 0);
+
 	void copy(const void * ptr, size_t s)
 	{
-		buffer_write(buffer, ptr, wrote, s);
+		void * span = buffer_reserve(&pos, s);
+		if (span != NULL)
+		{
+			memcpy(span, ptr, s);
+			buffer_commit(&pos, s);
+		}
+		else
+		{
+			// Value spans a page boundary
+			bufferpos_write(&pos, ptr, s);
+		}
+
 		wrote += s;
 	}
 
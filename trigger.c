@@ -8,8 +8,9 @@
 #include <kernel-priv.h>
 
 
-#define MAXIMUM_SLEEP_NANO		50000000	// Max sleep 50 milliseconds
+#define MAXIMUM_SLEEP_NANO		50000000	// Max sleep 50 milliseconds (idle clocks, and varclocks between rate checks)
 #define WARN_NSEC_TOLLERENCE	5000		// Warn if clock overshoot by (5 microseconds)
+#define CATCHUP_MAXIMUM			10			// Most missed periods a catch-up clock will run back to back
 
 #define VARCLOCK_RATE_PORT		"rate"
 
@@ -21,7 +22,7 @@ static inline void addnanos(struct timespec * val, uint64_t add_nanos)
 	val->tv_sec += nanos / NANOS_PER_SECOND;
 }
 
-static inline uint64_t diffnanos(struct timespec * a, struct timespec * b)
+static inline uint64_t diffnanos(const struct timespec * a, const struct timespec * b)
 {
 	int64_t diff = (a->tv_sec - b->tv_sec) * NANOS_PER_SECOND;
 	diff += a->tv_nsec - b->tv_nsec;
@@ -33,6 +34,16 @@ static inline uint64_t hz2nanos(double freq_hz)
 	return (1.0 / freq_hz) * NANOS_PER_SECOND;
 }
 
+static inline bool before(const struct timespec * a, const struct timespec * b)
+{
+	return a->tv_sec < b->tv_sec || (a->tv_sec == b->tv_sec && a->tv_nsec < b->tv_nsec);
+}
+
+static inline uint64_t timespec2nanos(const struct timespec * val)
+{
+	return (uint64_t)val->tv_sec * NANOS_PER_SECOND + val->tv_nsec;
+}
+
 static inline struct timespec nanos2timespec(uint64_t nanos)
 {
 	struct timespec tm;
@@ -75,66 +86,108 @@ bool trigger_watch(trigger_t * trigger)
 static ssize_t trigger_descclock(const kobject_t * object, char * buffer, size_t length)
 {
 	const trigger_clock_t * clk = (const trigger_clock_t *)object;
-	return snprintf(buffer, length, "{ 'frequency': %f }", clk->freq_hz);
+	return snprintf(buffer, length, "{ 'frequency': %f, 'overrun': '%s', 'overruns': %" PRIu64 ", 'skipped': %" PRIu64 ", 'deadline_runtime': %" PRIu64 ", 'deadline_refused': %s }", clk->freq_hz, (clk->overrun == model_overruncatchup)? "catchup" : "skip", clk->overruns, clk->skipped, clk->runtime_nsec, (clk->refused)? "True" : "False");
 }
 
-static bool trigger_waitclock(trigger_t * trigger)
+static void trigger_advanceclock(trigger_clock_t * clk, const struct timespec * now, bool slept)
 {
-	trigger_clock_t * clk = (void *)trigger;
+	// The deadline only ever moves along the original schedule (deadline + n * interval), so it never drifts
+	// Waking up late from the sleep is scheduling latency, only a period that ran past the deadline is an overrun
+	uint64_t late = before(now, &clk->deadline)? 0 : diffnanos(now, &clk->deadline);
+	clk->scheduled_nsec = timespec2nanos(&clk->deadline);
 
-	if (clk->interval_nsec == 0)
+	if ((slept || late <= WARN_NSEC_TOLLERENCE) && late < clk->interval_nsec)
 	{
-		// Trigger interval is 0 (never trigger), sleep max time and return false
-		struct timespec sleeptime = nanos2timespec(MAXIMUM_SLEEP_NANO);
-		nanosleep(&sleeptime, NULL);
+		clk->overrunning = false;
+		addnanos(&clk->deadline, clk->interval_nsec);
+		return;
+	}
 
-		return false;
+	if (!clk->overrunning)
+	{
+		LOGK(LOG_WARN, "Trigger %s overran its deadline by %" PRIu64 " nanoseconds", kobj_objectname(kobj_cast(trigger_cast(clk))), late);
 	}
 
+	clk->overrunning = true;
+	clk->overruns += 1;
+
+	// Periods after this deadline that have already gone by too
+	uint64_t missed = late / clk->interval_nsec;
+	uint64_t skip = (clk->overrun == model_overruncatchup)? ((missed > CATCHUP_MAXIMUM)? missed - CATCHUP_MAXIMUM : 0) : missed;
+
+	clk->skipped += skip;
+	addnanos(&clk->deadline, (skip + 1) * clk->interval_nsec);
+}
 
-	if (clk->last_trigger.tv_sec == 0 && clk->last_trigger.tv_nsec == 0)
+static bool trigger_sleepclock(trigger_clock_t * clk, uint64_t maximum_nanos)
+{
+	// Sleep until the absolute deadline (or at most maximum_nanos if non-zero), return true if the deadline was reached
+	struct timespec now;
+
+	if (clk->runtime_nsec != 0)
 	{
-		// Clock hasn't been init yet
-		clock_gettime(CLOCK_MONOTONIC, &clk->last_trigger);
+		// SCHED_DEADLINE wakes the thread at the start of every period, give back what's left of this one
+		// This is the job's only yield (kthread_dothread skips its own), a second one would throttle past the next period
+		sched_yield();
+
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		clk->scheduled_nsec = timespec2nanos(&now);
 		return true;
 	}
 
-	struct timespec now;
 	clock_gettime(CLOCK_MONOTONIC, &now);
 
-	uint64_t diff = diffnanos(&now, &clk->last_trigger);
-	if (diff >= clk->interval_nsec)
+	if (clk->deadline.tv_sec == 0 && clk->deadline.tv_nsec == 0)
 	{
-		if ((diff - WARN_NSEC_TOLLERENCE) > clk->interval_nsec)
+		// Clock hasn't been init yet, trigger right away
+		clk->deadline = now;
+	}
+
+	bool slept = before(&now, &clk->deadline);
+	if (slept)
+	{
+		struct timespec wakeup = clk->deadline;
+		bool partial = maximum_nanos != 0 && diffnanos(&clk->deadline, &now) > maximum_nanos;
+		if (partial)
 		{
-			LOGK(LOG_WARN, "Trigger %s has become unsynchronized (clock overshoot of %" PRIu64 " nanoseconds)", kobj_objectname(kobj_cast(trigger_cast(clk))), (diff - clk->interval_nsec));
-			clock_gettime(CLOCK_MONOTONIC, &clk->last_trigger);
+			wakeup = now;
+			addnanos(&wakeup, maximum_nanos);
 		}
-		else
+
+		if (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &wakeup, NULL) != 0 || partial)
 		{
-			addnanos(&clk->last_trigger, clk->interval_nsec);
+			// Interrupted (or not there yet), the caller will come back around
+			return false;
 		}
 
-		return true;
+		clock_gettime(CLOCK_MONOTONIC, &now);
 	}
 
-	uint64_t nanosleft = clk->interval_nsec - diff;
-	if (nanosleft >= MAXIMUM_SLEEP_NANO)
-	{
-		// Sleep maximum time
-		struct timespec sleeptime = nanos2timespec(MAXIMUM_SLEEP_NANO);
-		nanosleep(&sleeptime, NULL);
+	trigger_advanceclock(clk, &now, slept);
+	return true;
+}
 
-		return false;
-	}
-	else
-	{
-		struct timespec sleeptime = nanos2timespec(nanosleft);
-		nanosleep(&sleeptime, NULL);
+static bool trigger_idleclock(trigger_clock_t * clk)
+{
+	// Trigger interval is 0 (never trigger), sleep max time and return false
+	memset(&clk->deadline, 0, sizeof(struct timespec));
 
-		addnanos(&clk->last_trigger, clk->interval_nsec);
-		return true;
+	struct timespec sleeptime = nanos2timespec(MAXIMUM_SLEEP_NANO);
+	nanosleep(&sleeptime, NULL);
+
+	return false;
+}
+
+static bool trigger_waitclock(trigger_t * trigger)
+{
+	trigger_clock_t * clk = (void *)trigger;
+
+	if (clk->interval_nsec == 0)
+	{
+		return trigger_idleclock(clk);
 	}
+
+	return trigger_sleepclock(clk, 0);
 }
 
 trigger_clock_t * trigger_newclock(const char * name, double freq_hz)
@@ -143,10 +196,51 @@ trigger_clock_t * trigger_newclock(const char * name, double freq_hz)
 	trigger_clock_t * clk = trigger_new(str.string, trigger_descclock, NULL, trigger_waitclock, sizeof(trigger_clock_t));
 	clk->interval_nsec = hz2nanos(freq_hz);
 	clk->freq_hz = freq_hz;
+	clk->overrun = model_overrunskip;
 
 	return clk;
 }
 
+bool trigger_setdeadline(trigger_clock_t * clk, uint64_t runtime_nsec, exception_t ** err)
+{
+	// Sanity check
+	{
+		if unlikely(exception_check(err))
+		{
+			return false;
+		}
+
+		if unlikely(clk == NULL || clk->interval_nsec == 0)
+		{
+			exception_set(err, EINVAL, "Bad arguments!");
+			return false;
+		}
+	}
+
+	// Must be called on the thread the trigger wakes up
+	if (!kthread_setdeadline(runtime_nsec, clk->interval_nsec, err))
+	{
+		clk->refused = true;
+		return false;
+	}
+
+	clk->runtime_nsec = runtime_nsec;
+	return true;
+}
+
+void trigger_setoverrun(trigger_clock_t * clk, model_overrun_t overrun)
+{
+	// Sanity check
+	{
+		if unlikely(clk == NULL)
+		{
+			return;
+		}
+	}
+
+	clk->overrun = overrun;
+}
+
 // ----------------------- VARCLOCK ------------------------
 static void trigger_destroyvarclock(kobject_t * object)
 {
@@ -175,25 +269,49 @@ static bool trigger_waitvarclock(trigger_t * trigger)
 	}
 
 
-	uint64_t new_interval = (new_freq_hz == NULL)? clk->interval_nsec : hz2nanos(*new_freq_hz);
+	uint64_t new_interval = (new_freq_hz == NULL)? clk->interval_nsec : (*new_freq_hz > 0.0)? hz2nanos(*new_freq_hz) : 0;
 	if (new_interval != clk->interval_nsec)
 	{
-		clk->interval_nsec = new_interval;
-		clk->freq_hz = *new_freq_hz;
-
-		struct timespec now, trigger;
-		clock_gettime(CLOCK_MONOTONIC, &now);
-		memcpy(&trigger, &clk->last_trigger, sizeof(struct timespec));
+		if (clk->interval_nsec != 0 && new_interval != 0 && (clk->deadline.tv_sec != 0 || clk->deadline.tv_nsec != 0))
+		{
+			// Keep the phase, the next deadline is one new period after the last trigger
+			clk->deadline = nanos2timespec(timespec2nanos(&clk->deadline) - clk->interval_nsec + new_interval);
+
+			struct timespec now;
+			clock_gettime(CLOCK_MONOTONIC, &now);
+			if (before(&clk->deadline, &now))
+			{
+				// The new period has already gone by (rate went up), that isn't an overrun so trigger now
+				clk->deadline = now;
+			}
+		}
 
-		uint64_t diff = diffnanos(&now, &trigger);
-		if (diff > clk->interval_nsec)
+		if (clk->runtime_nsec != 0 && new_interval != 0)
 		{
-			memcpy(&clk->last_trigger, &now, sizeof(struct timespec));
-			return true;
+			// Ask for the new period, the runtime budget stays what was measured
+			exception_t * e = NULL;
+			if (!kthread_setdeadline(min(clk->runtime_nsec, new_interval), new_interval, &e))
+			{
+				LOGK(LOG_WARN, "Trigger %s could not change its SCHED_DEADLINE period, going back to SCHED_RR: %s", kobj_objectname(kobj_cast(trigger)), exception_message(e));
+				exception_free(e);
+
+				clk->runtime_nsec = 0;
+				clk->refused = true;
+				kthread_setroundrobin((kthread_self() == NULL)? 0 : kthread_self()->priority);
+			}
 		}
+
+		clk->interval_nsec = new_interval;
+		clk->freq_hz = *new_freq_hz;
+	}
+
+	if (clk->interval_nsec == 0)
+	{
+		return trigger_idleclock(clk);
 	}
 
-	return trigger_waitclock(trigger);
+	// Wake up at least every MAXIMUM_SLEEP_NANO to look for a new rate
+	return trigger_sleepclock(clk, MAXIMUM_SLEEP_NANO);
 }
 
 trigger_varclock_t * trigger_newvarclock(const char * name, double initial_freq_hz, exception_t ** err)
@@ -216,6 +334,7 @@ trigger_varclock_t * trigger_newvarclock(const char * name, double initial_freq_
 	trigger_varclock_t * vclk = trigger_new(name, trigger_descclock, trigger_destroyvarclock, trigger_waitvarclock, sizeof(trigger_varclock_t));
 	vclk->clock.interval_nsec = hz2nanos(initial_freq_hz);
 	vclk->clock.freq_hz = initial_freq_hz;
+	vclk->clock.overrun = model_overrunskip;
 	linklist_init(&vclk->links);
 	portlist_init(&vclk->ports);
 
@@ -0,0 +1,150 @@
+#include <time.h>
+
+#include <aul/string.h>
+
+#include <array.h>
+
+#include "unittest.h"
+
+#define BENCH_POOLSIZE		(64 * 1024 * 1024)		// 64 MB
+#define BENCH_ELEMS			(1024 * 1024)			// 8 MB of doubles
+#define BENCH_REPEAT		20
+
+static double bench_since(const struct timespec * start, size_t ops)
+{
+	struct timespec end;
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	double nanos = (end.tv_sec - start->tv_sec) * (double)NANOS_PER_SECOND + (end.tv_nsec - start->tv_nsec);
+	return nanos / ops;
+}
+
+static void bench_kernels(bool large)
+{
+	array_t * x = (large)? buffer_newlarge(BENCH_ELEMS * sizeof(double)) : array_new();
+	array_t * y = (large)? buffer_newlarge(BENCH_ELEMS * sizeof(double)) : array_new();
+	for (size_t index = 0; index < BENCH_ELEMS; index++)
+	{
+		double value = index;
+		array_writeindex(x, T_ARRAY_DOUBLE, index, &value);
+		array_writeindex(y, T_ARRAY_DOUBLE, index, &value);
+	}
+
+	const char * kind = (large)? "large" : "paged";
+	volatile double result = 0.0;
+	struct timespec start;
+	string_t desc = string_blank();
+
+	// Element-wise reference, the way modules reduce an array today
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (size_t round = 0; round < BENCH_REPEAT; round++)
+	{
+		double total = 0.0;
+		for (size_t index = 0; index < BENCH_ELEMS; index++)
+		{
+			double value = 0.0;
+			array_readindex(x, T_ARRAY_DOUBLE, index, &value);
+			total += value;
+		}
+
+		result += total;
+	}
+
+	string_set(&desc, "Sum %s doubles, element-wise (per element)", kind);
+	bench(desc.string, bench_since(&start, BENCH_REPEAT * BENCH_ELEMS));
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (size_t round = 0; round < BENCH_REPEAT; round++)
+	{
+		result += array_sum(x);
+	}
+
+	string_set(&desc, "Sum %s doubles, array_sum (per element)", kind);
+	bench(desc.string, bench_since(&start, BENCH_REPEAT * BENCH_ELEMS));
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (size_t round = 0; round < BENCH_REPEAT; round++)
+	{
+		result += array_max(x);
+	}
+
+	string_set(&desc, "Max %s doubles, array_max (per element)", kind);
+	bench(desc.string, bench_since(&start, BENCH_REPEAT * BENCH_ELEMS));
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (size_t round = 0; round < BENCH_REPEAT; round++)
+	{
+		result += array_dot(x, y);
+	}
+
+	string_set(&desc, "Dot %s doubles, array_dot (per element)", kind);
+	bench(desc.string, bench_since(&start, BENCH_REPEAT * BENCH_ELEMS));
+
+	// Element-wise reference axpy
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (size_t round = 0; round < BENCH_REPEAT; round++)
+	{
+		for (size_t index = 0; index < BENCH_ELEMS; index++)
+		{
+			double a = 0.0, b = 0.0;
+			array_readindex(x, T_ARRAY_DOUBLE, index, &a);
+			array_readindex(y, T_ARRAY_DOUBLE, index, &b);
+			b += 0.5 * a;
+			array_writeindex(y, T_ARRAY_DOUBLE, index, &b);
+		}
+	}
+
+	string_set(&desc, "Axpy %s doubles, element-wise (per element)", kind);
+	bench(desc.string, bench_since(&start, BENCH_REPEAT * BENCH_ELEMS));
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (size_t round = 0; round < BENCH_REPEAT; round++)
+	{
+		array_axpy(y, 0.5, x);
+	}
+
+	string_set(&desc, "Axpy %s doubles, array_axpy (per element)", kind);
+	bench(desc.string, bench_since(&start, BENCH_REPEAT * BENCH_ELEMS));
+
+	// Element-wise reference conversion
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (size_t round = 0; round < BENCH_REPEAT; round++)
+	{
+		array_t * ints = array_new();
+		for (size_t index = 0; index < BENCH_ELEMS; index++)
+		{
+			double value = 0.0;
+			array_readindex(x, T_ARRAY_DOUBLE, index, &value);
+
+			int converted = (int)value;
+			array_writeindex(ints, T_ARRAY_INTEGER, index, &converted);
+		}
+
+		array_free(ints);
+	}
+
+	string_set(&desc, "Convert %s doubles to integers, element-wise (per element)", kind);
+	bench(desc.string, bench_since(&start, BENCH_REPEAT * BENCH_ELEMS));
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (size_t round = 0; round < BENCH_REPEAT; round++)
+	{
+		array_free(array_convert(x, T_ARRAY_DOUBLE, T_ARRAY_INTEGER));
+	}
+
+	string_set(&desc, "Convert %s doubles to integers, array_convert (per element)", kind);
+	bench(desc.string, bench_since(&start, BENCH_REPEAT * BENCH_ELEMS));
+
+	array_free(x);
+	array_free(y);
+}
+
+void bench_array()
+{
+	module("Array benchmarks");
+
+	buffer_init(BENCH_POOLSIZE, BENCH_POOLSIZE, 0, NULL);
+	bench_kernels(false);
+	bench_kernels(true);
+	buffer_destroy();
+}
@@ -0,0 +1,325 @@
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/socket.h>
+
+#include <aul/mutex.h>
+#include <aul/stack.h>
+#include <aul/string.h>
+
+#include <buffer.h>
+#include <array.h>
+
+#include "unittest.h"
+
+#define BENCH_POOLSIZE		(16 * 1024 * 1024)		// 16 MB
+#define BENCH_OPS			200000
+#define BENCH_BATCH			16
+#define BENCH_ACCESSES		100000
+#define BENCH_MAXSIZE		(64 * 1024 * 1024)		// 64 MB
+#define BENCH_STREAMSIZE	(4 * 1024 * 1024)		// 4 MB
+#define BENCH_REPEAT		20
+#define BENCH_LINKS			4
+
+
+// Reference allocator, the single global lock + free stack the pool used before thread caches
+static stack_t ref_freepages;
+static mutex_t ref_freelock;
+
+static void * ref_getfree()
+{
+	void * page = NULL;
+	mutex_lock(&ref_freelock);
+	{
+		page = stack_pop(&ref_freepages);
+	}
+	mutex_unlock(&ref_freelock);
+
+	return page;
+}
+
+static void ref_putfree(void * page)
+{
+	mutex_lock(&ref_freelock);
+	{
+		stack_push(&ref_freepages, page);
+	}
+	mutex_unlock(&ref_freelock);
+}
+
+static void * bench_doref(void * object)
+{
+	unused(object);
+
+	void * held[BENCH_BATCH];
+	for (size_t op = 0; op < BENCH_OPS; op += BENCH_BATCH)
+	{
+		for (size_t i = 0; i < BENCH_BATCH; i++)	if ((held[i] = ref_getfree()) != NULL) memset(held[i], 0, BUFFER_PAGESIZE);
+		for (size_t i = 0; i < BENCH_BATCH; i++)	if (held[i] != NULL) ref_putfree(held[i]);
+	}
+
+	return NULL;
+}
+
+static void * bench_dopool(void * object)
+{
+	unused(object);
+
+	buffer_t * held[BENCH_BATCH];
+	for (size_t op = 0; op < BENCH_OPS; op += BENCH_BATCH)
+	{
+		for (size_t i = 0; i < BENCH_BATCH; i++)	held[i] = buffer_new();
+		for (size_t i = 0; i < BENCH_BATCH; i++)	buffer_free(held[i]);
+	}
+
+	return NULL;
+}
+
+static double bench_since(const struct timespec * start, size_t ops)
+{
+	struct timespec end;
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	double nanos = (end.tv_sec - start->tv_sec) * (double)NANOS_PER_SECOND + (end.tv_nsec - start->tv_nsec);
+	return nanos / ops;
+}
+
+static void bench_access(size_t size)
+{
+	static uint8_t chunk[64 * 1024];
+	memset(chunk, 0xA5, sizeof(chunk));
+
+	// Build the buffer by appending
+	struct timespec start;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	buffer_t * b = buffer_new();
+	size_t appends = 0;
+	for (size_t offset = 0; offset < size; offset += sizeof(chunk), appends += 1)
+	{
+		buffer_write(b, chunk, buffer_size(b), min(sizeof(chunk), size - offset));
+	}
+
+	string_t desc = string_new("Append 64 KB chunks, %zu KB buffer", size / 1024);
+	bench(desc.string, bench_since(&start, appends));
+
+	// Size queries
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	volatile size_t total = 0;
+	for (size_t i = 0; i < BENCH_ACCESSES; i++)
+	{
+		total += buffer_size(b);
+	}
+
+	string_set(&desc, "Size query, %zu KB buffer", size / 1024);
+	bench(desc.string, bench_since(&start, BENCH_ACCESSES));
+
+	// Random 8 byte reads
+	unsigned int seed = 1;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (size_t i = 0; i < BENCH_ACCESSES; i++)
+	{
+		uint64_t value = 0;
+		buffer_read(b, &value, rand_r(&seed) % (size - sizeof(uint64_t)), sizeof(uint64_t));
+		total += value;
+	}
+
+	string_set(&desc, "Random read, %zu KB buffer", size / 1024);
+	bench(desc.string, bench_since(&start, BENCH_ACCESSES));
+
+	// Random 8 byte writes (pages already exclusive, no copy-on-write)
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (size_t i = 0; i < BENCH_ACCESSES; i++)
+	{
+		uint64_t value = i;
+		buffer_write(b, &value, rand_r(&seed) % (size - sizeof(uint64_t)), sizeof(uint64_t));
+	}
+
+	string_set(&desc, "Random write, %zu KB buffer", size / 1024);
+	bench(desc.string, bench_since(&start, BENCH_ACCESSES));
+
+	buffer_free(b);
+}
+
+static void bench_stream(bool large)
+{
+	static uint8_t chunk[64 * 1024];
+	memset(chunk, 0x5A, sizeof(chunk));
+
+	buffer_t * b = (large)? buffer_newlarge(BENCH_STREAMSIZE) : buffer_new();
+	for (size_t offset = 0; offset < BENCH_STREAMSIZE; offset += sizeof(chunk))
+	{
+		buffer_write(b, chunk, offset, sizeof(chunk));
+	}
+
+	// Send the buffer through a socket pair, draining the other end as we go
+	int fds[2];
+	socketpair(AF_UNIX, SOCK_STREAM, 0, fds);
+
+	int sndbuf = sizeof(chunk) * 2;
+	setsockopt(fds[0], SOL_SOCKET, SO_SNDBUF, &sndbuf, sizeof(sndbuf));
+	setsockopt(fds[1], SOL_SOCKET, SO_RCVBUF, &sndbuf, sizeof(sndbuf));
+
+	struct timespec start;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (size_t round = 0; round < BENCH_REPEAT; round++)
+	{
+		bufferpos_t pos;
+		bufferpos_new(&pos, b, 0);
+		while (bufferpos_remaining(&pos) > 0)
+		{
+			ssize_t sent = bufferpos_send(&pos, fds[0], sizeof(chunk));
+			for (ssize_t drained = 0; drained < sent; )
+			{
+				drained += read(fds[1], chunk, sent - drained);
+			}
+		}
+	}
+
+	string_t desc = string_new("Send %d MB %s buffer over socket (per MB)", BENCH_STREAMSIZE / (1024 * 1024), (large)? "large" : "paged");
+	bench(desc.string, bench_since(&start, BENCH_REPEAT * (BENCH_STREAMSIZE / (1024 * 1024))));
+
+	close(fds[0]);
+	close(fds[1]);
+
+	// Sum an array of doubles, the way a block reduces an array input
+	array_t * a = (large)? buffer_newlarge(BENCH_STREAMSIZE) : array_new();
+	for (size_t index = 0; index < BENCH_STREAMSIZE / sizeof(double); index++)
+	{
+		double value = index;
+		array_writeindex(a, T_ARRAY_DOUBLE, index, &value);
+	}
+
+	size_t elems = array_size(a, T_ARRAY_DOUBLE);
+	volatile double sum = 0.0;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (size_t round = 0; round < BENCH_REPEAT; round++)
+	{
+		double values[512], total = 0.0;
+		for (size_t index = 0; index < elems; index += nelems(values))
+		{
+			size_t read = array_read(a, T_ARRAY_DOUBLE, index, values, nelems(values));
+			for (size_t i = 0; i < read; i++)
+			{
+				total += values[i];
+			}
+		}
+
+		sum += total;
+	}
+
+	string_set(&desc, "Sum %s array of %zu doubles (per element)", (large)? "large" : "paged", elems);
+	bench(desc.string, bench_since(&start, BENCH_REPEAT * elems));
+
+	array_free(a);
+	buffer_free(b);
+}
+
+static void bench_links(size_t elems, bool inlined)
+{
+	// Mimic a block output fanned out over a chain of links: the output is copied into its backing
+	// (iobacking_copy) and every link frees the destination and dups the source (copy_x2x), or with
+	// inlined, copies small arrays straight into inline storage in the backing (iobacking_copyarray)
+	array_t * out = array_new();
+	array_t * backings[BENCH_LINKS + 1] = {0};
+	static uint64_t storage[BENCH_LINKS + 1][BUFFER_INLINESIZE / sizeof(uint64_t)];
+
+	struct timespec start;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (size_t op = 0; op < BENCH_OPS; op++)
+	{
+		double value = op;
+		array_writeindex(out, T_ARRAY_DOUBLE, op % elems, &value);
+
+		for (size_t i = 0; i <= BENCH_LINKS; i++)
+		{
+			const array_t * from = (i == 0)? out : backings[i - 1];
+			if (inlined)
+			{
+				size_t size = buffer_size(from);
+				bufferpos_t pos;
+				bufferpos_new(&pos, buffer_newinline(storage[i]), 0);
+				buffer_read(from, buffer_reserve(&pos, size), 0, size);
+				buffer_commit(&pos, size);
+				backings[i] = pos.buffer;
+			}
+			else
+			{
+				array_free(backings[i]);
+				backings[i] = array_dup(from);
+			}
+		}
+	}
+
+	string_t desc = string_new("Output + %d link hops, %zu doubles%s (per cycle)", BENCH_LINKS, elems, (inlined)? " inline" : "");
+	bench(desc.string, bench_since(&start, BENCH_OPS));
+
+	for (size_t i = 0; i <= BENCH_LINKS; i++)
+	{
+		array_free(backings[i]);
+	}
+	array_free(out);
+}
+
+static double bench_run(void * (*func)(void *), size_t numthreads)
+{
+	struct timespec start, end;
+	pthread_t threads[numthreads];
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (size_t i = 0; i < numthreads; i++)
+	{
+		pthread_create(&threads[i], NULL, func, NULL);
+	}
+
+	for (size_t i = 0; i < numthreads; i++)
+	{
+		pthread_join(threads[i], NULL);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	double nanos = (end.tv_sec - start.tv_sec) * (double)NANOS_PER_SECOND + (end.tv_nsec - start.tv_nsec);
+	return nanos / (BENCH_OPS * numthreads);
+}
+
+void bench_buffer()
+{
+	module("Buffer benchmarks");
+
+	static uint8_t refmemory[BENCH_POOLSIZE] __attribute__((aligned(BUFFER_PAGESIZE)));
+	stack_init(&ref_freepages);
+	mutex_init(&ref_freelock, M_RECURSIVE);
+	for (size_t i = 0; i < BENCH_POOLSIZE / BUFFER_PAGESIZE; i++)
+	{
+		stack_push(&ref_freepages, (list_t *)&refmemory[i * BUFFER_PAGESIZE]);
+	}
+
+	buffer_init(BENCH_POOLSIZE, BENCH_POOLSIZE, 0, NULL);
+
+	size_t numthreads[] = { 1, 2, 4, 8 };
+	for (size_t i = 0; i < nelems(numthreads); i++)
+	{
+		string_t desc = string_new("Alloc/free, global lock, %zu thread(s)", numthreads[i]);
+		bench(desc.string, bench_run(bench_doref, numthreads[i]));
+
+		string_set(&desc, "Alloc/free, thread caches, %zu thread(s)", numthreads[i]);
+		bench(desc.string, bench_run(bench_dopool, numthreads[i]));
+	}
+
+	buffer_destroy();
+	mutex_destroy(&ref_freelock);
+
+	buffer_init(BENCH_MAXSIZE * 2, BENCH_MAXSIZE * 2, 0, NULL);
+	for (size_t size = 1024; size <= BENCH_MAXSIZE; size *= 4)
+	{
+		bench_access(size);
+	}
+
+	bench_stream(false);
+	bench_stream(true);
+	bench_links(16, false);
+	bench_links(16, true);
+	bench_links(256, false);
+	buffer_destroy();
+}
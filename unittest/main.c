@@ -1,4 +1,5 @@
 #include <stdio.h>
+#include <string.h>
 #include <sys/ioctl.h>
 #include <sys/types.h>
 
@@ -51,6 +52,19 @@ void logtest(const char * str, bool pass)
 }
 
 
+void bench(const char * desc, double nanos_per_op)
+{
+	char value[LINEBUF];
+	sprintf(value, " [ %10.1f ns/op ] ", nanos_per_op);
+
+	printf(term_teststr, desc, value);
+	if (log != NULL)
+	{
+		fprintf(log, " [ %.1f ns/op ] %s\n", nanos_per_op, desc);
+	}
+}
+
+
 void module(const char * modname)
 {
 	printheader(modname);
@@ -74,8 +88,11 @@ void __assert(bool val, const char * valstr, const char * desc)
 	logtest(line, val);
 }
 
-int main()
+int main(int argc, char ** argv)
 {
+	// Benchmarks take minutes, only run them when asked (make bench)
+	bool benchmarks = argc > 1 && strcmp(argv[1], "--bench") == 0;
+
 	{ // Get the terminal width
 		struct winsize w;
 		ioctl(0, TIOCGWINSZ, &w);
@@ -93,6 +110,19 @@ int main()
 	
 	// Run through tests
 	test_serialize();
+	test_buffer();
+	test_array();
+	test_histogram();
+	test_link();
+	test_port();
+	test_trigger();
+
+	// Run through benchmarks
+	if (benchmarks)
+	{
+		bench_buffer();
+		bench_array();
+	}
 	
 	
 	return 0;
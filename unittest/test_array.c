@@ -0,0 +1,154 @@
+#include <math.h>
+#include <string.h>
+
+#include <array.h>
+
+#include "unittest.h"
+
+#define TEST_POOLSIZE		(8 * 1024 * 1024)		// 8 MB
+#define TEST_ELEMS			3001					// Odd count, spans pages and leaves vector tails
+
+static array_t * test_array_doubles(size_t elems, off_t skip)
+{
+	// Build the array behind a few bytes of padding and slice them off, so doubles straddle page boundaries
+	buffer_t * padded = buffer_new();
+	for (size_t i = 0; i < elems; i++)
+	{
+		double value = (double)i - (double)elems / 2.0;
+		buffer_write(padded, &value, skip + i * sizeof(double), sizeof(double));
+	}
+
+	array_t * array = buffer_slice(padded, skip, elems * sizeof(double));
+	buffer_free(padded);
+	return array;
+}
+
+void test_array()
+{
+	module("Array");
+
+	exception_t * e = NULL;
+	assert(buffer_init(TEST_POOLSIZE, TEST_POOLSIZE, 0, &e) && !exception_check(&e), "Initialize buffer pool");
+
+	// Reductions
+	{
+		double sum = 0.0, min = INFINITY, max = -INFINITY;
+		for (size_t i = 0; i < TEST_ELEMS; i++)
+		{
+			double value = (double)i - (double)TEST_ELEMS / 2.0;
+			sum += value;
+			min = fmin(min, value);
+			max = fmax(max, value);
+		}
+
+		array_t * aligned = test_array_doubles(TEST_ELEMS, 0);
+		array_t * straddled = test_array_doubles(TEST_ELEMS, 3);
+
+		assert(array_sum(aligned) == sum && array_sum(straddled) == sum, "Sum of doubles");
+		assert(array_min(aligned) == min && array_min(straddled) == min, "Min of doubles");
+		assert(array_max(aligned) == max && array_max(straddled) == max, "Max of doubles");
+		assert(array_mean(straddled) == sum / TEST_ELEMS, "Mean of doubles");
+
+		array_t * empty = array_new();
+		assert(array_sum(empty) == 0.0 && isnan(array_min(empty)) && isnan(array_mean(empty)), "Reductions of empty array");
+		array_free(empty);
+
+		double dot = 0.0;
+		for (size_t i = 0; i < TEST_ELEMS; i++)
+		{
+			double value = (double)i - (double)TEST_ELEMS / 2.0;
+			dot += value * value;
+		}
+
+		assert(fabs(array_dot(aligned, straddled) - dot) <= dot * 1e-12, "Dot product across differently aligned arrays");
+
+		array_free(aligned);
+		array_free(straddled);
+	}
+
+	// In-place kernels
+	{
+		array_t * y = test_array_doubles(TEST_ELEMS, 5);
+		array_t * x = test_array_doubles(TEST_ELEMS, 0);
+		array_t * shared = array_dup(y);
+
+		bool pass = array_axpy(y, 2.0, x);
+		for (size_t i = 0; i < TEST_ELEMS && pass; i++)
+		{
+			double value = 0.0;
+			array_readindex(y, T_ARRAY_DOUBLE, i, &value);
+			pass = (value == 3.0 * ((double)i - (double)TEST_ELEMS / 2.0));
+		}
+
+		assert(pass, "Axpy of doubles");
+		assert(array_sum(shared) == array_sum(x), "Axpy leaves shared copies alone");
+
+		pass = array_clamp(x, -10.0, 20.5);
+		assert(pass && array_min(x) == -10.0 && array_max(x) == 20.5 && array_size(x, T_ARRAY_DOUBLE) == TEST_ELEMS, "Clamp doubles");
+
+		array_free(x);
+		array_free(y);
+		array_free(shared);
+	}
+
+	// Conversions
+	{
+		array_t * doubles = test_array_doubles(TEST_ELEMS, 1);
+		array_t * ints = array_convert(doubles, T_ARRAY_DOUBLE, T_ARRAY_INTEGER);
+		assert(ints != NULL && array_size(ints, T_ARRAY_INTEGER) == TEST_ELEMS, "Convert doubles to integers");
+
+		bool pass = true;
+		double sum = 0.0;
+		for (size_t i = 0; i < TEST_ELEMS && pass; i++)
+		{
+			int value = 0;
+			array_readindex(ints, T_ARRAY_INTEGER, i, &value);
+			pass = (value == (int)((double)i - (double)TEST_ELEMS / 2.0));
+			sum += value;
+		}
+
+		assert(pass, "Doubles truncate to integers");
+
+		array_t * back = array_convert(ints, T_ARRAY_INTEGER, T_ARRAY_DOUBLE);
+		assert(back != NULL && array_sum(back) == sum, "Convert integers to doubles");
+
+		array_t * bools = array_convert(ints, T_ARRAY_INTEGER, T_ARRAY_BOOLEAN);
+		array_t * ones = array_convert(bools, T_ARRAY_BOOLEAN, T_ARRAY_INTEGER);
+
+		size_t zeros = 0;
+		pass = (ones != NULL && array_size(ones, T_ARRAY_INTEGER) == TEST_ELEMS);
+		for (size_t i = 0; i < TEST_ELEMS && pass; i++)
+		{
+			int value = 0, one = 0;
+			array_readindex(ints, T_ARRAY_INTEGER, i, &value);
+			array_readindex(ones, T_ARRAY_INTEGER, i, &one);
+			pass = (one == (value != 0));
+			zeros += (one == 0)? 1 : 0;
+		}
+
+		assert(pass && zeros == 2, "Integers to booleans and back");		// -0.5 and 0.5 both truncate to 0
+		assert(array_convert(doubles, T_ARRAY_DOUBLE, T_DOUBLE) == NULL, "Convert rejects non-array types");
+
+		// Whole-array conversion into inline storage, the way a conversion link fills a small backing
+		uint64_t storage[BUFFER_INLINESIZE / sizeof(uint64_t)];
+		array_t * small = array_new();
+		for (int i = 0; i < 16; i++)
+		{
+			array_writeindex(small, T_ARRAY_INTEGER, i, &i);
+		}
+
+		array_t * inlined = buffer_newinline(storage);
+		pass = array_convertinto(inlined, T_ARRAY_DOUBLE, small, T_ARRAY_INTEGER);
+		assert(pass && array_size(inlined, T_ARRAY_DOUBLE) == 16 && array_sum(inlined) == 120.0, "Convert integers to doubles into inline storage");
+		assert(!array_convertinto(inlined, T_ARRAY_DOUBLE, ints, T_ARRAY_INTEGER), "Conversion fails when inline storage overflows");
+		array_free(small);
+
+		array_free(doubles);
+		array_free(ints);
+		array_free(back);
+		array_free(bools);
+		array_free(ones);
+	}
+
+	buffer_destroy();
+}
@@ -0,0 +1,648 @@
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include <buffer.h>
+
+#include "unittest.h"
+
+#define TEST_POOLSIZE		(8 * 1024 * 1024)		// 8 MB
+#define TEST_THREADS		4
+#define TEST_ROUNDS			2000
+
+static void * test_buffer_dothread(void * object)
+{
+	bool * pass = object;
+	buffer_t * held[32];
+
+	for (size_t round = 0; round < TEST_ROUNDS; round++)
+	{
+		for (size_t i = 0; i < nelems(held); i++)
+		{
+			held[i] = buffer_new();
+			if (held[i] == NULL || buffer_write(held[i], &round, 0, sizeof(size_t)) != sizeof(size_t))
+			{
+				*pass = false;
+				return NULL;
+			}
+		}
+
+		for (size_t i = 0; i < nelems(held); i++)
+		{
+			size_t value = 0;
+			if (buffer_read(held[i], &value, 0, sizeof(size_t)) != sizeof(size_t) || value != round)
+			{
+				*pass = false;
+			}
+
+			buffer_free(held[i]);
+		}
+	}
+
+	return NULL;
+}
+
+static buffer_t * test_buffer_held[BUFFER_ARENASIZE / BUFFER_PAGESIZE];
+static size_t test_buffer_numheld = 0;
+
+static size_t test_buffer_doreclaim(void * userdata)
+{
+	unused(userdata);
+
+	if (test_buffer_numheld == 0)
+	{
+		return 0;
+	}
+
+	test_buffer_numheld -= 1;
+	buffer_free(test_buffer_held[test_buffer_numheld]);
+	return 1;
+}
+
+static void * test_buffer_doshrink(void * object)
+{
+	unused(object);
+
+	// Give the main thread time to start waiting, then drop the emergency reserve
+	usleep(50 * 1000);
+	buffer_setpolicy(10 * NANOS_PER_SECOND, 0);
+
+	return NULL;
+}
+
+static void * test_buffer_dorealtime(void * object)
+{
+	buffer_setrealtime(true);
+
+	buffer_t * b = buffer_new();
+	*(bool *)object = (b != NULL);
+	buffer_free(b);
+
+	return NULL;
+}
+
+void test_buffer()
+{
+	module("Buffer");
+
+	exception_t * e = NULL;
+	assert(buffer_init(TEST_POOLSIZE, TEST_POOLSIZE, 0, &e) && !exception_check(&e), "Initialize buffer pool");
+
+	// Small buffer read/write
+	{
+		buffer_t * b = buffer_new();
+		assert(b != NULL, "Allocate small buffer");
+
+		const char data[] = "Hello, world";
+		char read[sizeof(data)] = {0};
+		assert(buffer_write(b, data, 0, sizeof(data)) == sizeof(data), "Write to small buffer");
+		assert(buffer_read(b, read, 0, sizeof(read)) == sizeof(data) && memcmp(data, read, sizeof(data)) == 0, "Read back small buffer");
+		assert(buffer_size(b) == sizeof(data), "Small buffer size");
+
+		// Duplicating a small buffer takes a single page
+		bufferstats_t before, after;
+		buffer_stats(&before);
+		buffer_t * d1 = buffer_dup(b);
+		buffer_stats(&after);
+		buffer_t * d2 = buffer_dup(d1);
+		assert(d1 != NULL && d2 != NULL && buffer_size(d2) == sizeof(data), "Duplicate small buffer");
+		assert(after.pages_inuse == before.pages_inuse + 1, "Duplicate small buffer in one page");
+
+		buffer_write(d1, "J", 0, 1);
+		assert(buffer_read(d2, read, 0, sizeof(read)) == sizeof(data) && memcmp(data, read, sizeof(data)) == 0, "Write leaves small duplicate intact");
+		assert(buffer_read(d1, read, 0, sizeof(read)) == sizeof(data) && read[0] == 'J' && memcmp(&data[1], &read[1], sizeof(data) - 1) == 0, "Write updates small duplicate");
+
+		static uint8_t big[2 * BUFFER_PAGESIZE];
+		buffer_write(d2, big, sizeof(data), sizeof(big));
+		assert(buffer_size(d2) == sizeof(data) + sizeof(big) && buffer_read(d2, read, 0, sizeof(read)) == sizeof(data) && memcmp(data, read, sizeof(data)) == 0, "Promote duplicated small buffer");
+
+		// A duplicate's page isn't cleared past the copied bytes, a write past the end must still leave zeros behind it
+		{
+			static uint8_t dirty[1024], gap[1024];
+			memset(dirty, 0xFF, sizeof(dirty));
+
+			buffer_t * g = buffer_new();
+			buffer_write(g, dirty, 0, sizeof(dirty));
+			buffer_free(g);
+
+			buffer_t * d3 = buffer_dup(b);
+			buffer_write(d3, "!", sizeof(gap), 1);
+
+			memset(gap, 0xFF, sizeof(gap));
+			buffer_read(d3, gap, 0, sizeof(gap));
+			bool zeros = true;
+			for (size_t i = sizeof(data); i < sizeof(gap); i++)
+			{
+				zeros &= (gap[i] == 0);
+			}
+
+			assert(buffer_size(d3) == sizeof(gap) + 1 && zeros, "Gap past the end of a small duplicate reads as zeros");
+			buffer_free(d3);
+		}
+
+		buffer_free(d2);
+		buffer_free(d1);
+		buffer_free(b);
+	}
+
+	// Large buffer read/write (promoted, multi-page)
+	{
+		static uint8_t data[3 * BUFFER_PAGESIZE + 123];
+		static uint8_t read[sizeof(data)];
+		for (size_t i = 0; i < sizeof(data); i++)
+		{
+			data[i] = (uint8_t)(i * 7);
+		}
+
+		buffer_t * b = buffer_new();
+		assert(buffer_write(b, data, 0, sizeof(data)) == sizeof(data), "Write to large buffer");
+		assert(buffer_size(b) == sizeof(data), "Large buffer size");
+
+		buffer_t * d = buffer_dup(b);
+		assert(d != NULL, "Duplicate large buffer");
+
+		uint8_t byte = 0xFF;
+		buffer_write(d, &byte, 10, 1);
+		assert(buffer_read(b, read, 0, sizeof(read)) == sizeof(data) && memcmp(data, read, sizeof(data)) == 0, "Copy-on-write leaves source intact");
+		assert(buffer_read(d, &byte, 10, 1) == 1 && byte == 0xFF, "Copy-on-write updates duplicate");
+
+		buffer_free(d);
+		buffer_free(b);
+	}
+
+	// Sparse buffer reaching through the segment tables
+	{
+		const size_t far = 3 * 1024 * 1024;
+		uint64_t value = 0x0123456789ABCDEFULL, readback = 0;
+
+		buffer_t * b = buffer_new();
+		assert(buffer_write(b, &value, far, sizeof(value)) == sizeof(value), "Write past the direct pages");
+		assert(buffer_size(b) == far + sizeof(value), "Sparse buffer size");
+		assert(buffer_read(b, &readback, far, sizeof(readback)) == sizeof(readback) && readback == value, "Read back through segment table");
+		assert(buffer_read(b, &readback, far / 2, sizeof(readback)) == sizeof(readback) && readback == 0, "Holes read as zeros");
+
+		buffer_t * d = buffer_dup(b);
+		uint64_t other = ~value;
+		buffer_write(d, &other, far, sizeof(other));
+		assert(buffer_read(b, &readback, far, sizeof(readback)) == sizeof(readback) && readback == value, "Copy-on-write of shared segment table");
+
+		buffer_free(d);
+		buffer_free(b);
+	}
+
+	// Slices share the pages of the source buffer
+	{
+		static uint8_t data[5 * BUFFER_PAGESIZE];
+		static uint8_t read[sizeof(data)];
+		for (size_t i = 0; i < sizeof(data); i++)
+		{
+			data[i] = (uint8_t)(i * 13);
+		}
+
+		buffer_t * b = buffer_new();
+		buffer_write(b, data, 0, sizeof(data));
+
+		const size_t offset = BUFFER_PAGESIZE + 17, length = 2 * BUFFER_PAGESIZE + 5;
+		buffer_t * s = buffer_slice(b, offset, length);
+		assert(s != NULL && buffer_size(s) == length, "Slice large buffer");
+		assert(buffer_read(s, read, 0, sizeof(read)) == length && memcmp(&data[offset], read, length) == 0, "Read back slice");
+
+		buffer_t * ss = buffer_slice(s, 100, 50);
+		assert(ss != NULL && buffer_read(ss, read, 0, sizeof(read)) == 50 && memcmp(&data[offset + 100], read, 50) == 0, "Slice of a slice");
+
+		uint8_t byte = 0xFF;
+		buffer_write(s, &byte, 0, 1);
+		assert(buffer_read(b, read, 0, sizeof(read)) == sizeof(data) && memcmp(data, read, sizeof(data)) == 0, "Writing to slice leaves source intact");
+		assert(buffer_read(ss, read, 0, 50) == 50 && memcmp(&data[offset + 100], read, 50) == 0, "Writing to slice leaves sub-slice intact");
+
+		// Growing a slice past its end doesn't expose the source data behind it
+		uint8_t gap[64];
+		buffer_write(ss, &byte, 50 + sizeof(gap), 1);
+		assert(buffer_size(ss) == 50 + sizeof(gap) + 1 && buffer_read(ss, gap, 50, sizeof(gap)) == sizeof(gap) && gap[0] == 0 && gap[sizeof(gap) - 1] == 0, "Gap past the end of a slice reads as zeros");
+		buffer_write(s, &byte, length + 2 * BUFFER_PAGESIZE, 1);
+		assert(buffer_read(s, gap, length, sizeof(gap)) == sizeof(gap) && gap[0] == 0 && gap[sizeof(gap) - 1] == 0, "Gap across pages past the end of a slice reads as zeros");
+		assert(buffer_read(b, read, 0, sizeof(read)) == sizeof(data) && memcmp(data, read, sizeof(data)) == 0, "Growing a slice leaves source intact");
+
+		buffer_t * e = buffer_slice(b, sizeof(data) + 10, 10);
+		assert(e != NULL && buffer_size(e) == 0, "Slice past the end is empty");
+
+		buffer_t * small = buffer_new();
+		buffer_write(small, "Hello, world", 0, 12);
+		buffer_t * st = buffer_slice(small, 7, 100);
+		assert(st != NULL && buffer_size(st) == 5 && buffer_read(st, read, 0, 5) == 5 && memcmp(read, "world", 5) == 0, "Slice small buffer");
+
+		buffer_free(st);
+		buffer_free(small);
+		buffer_free(e);
+		buffer_free(ss);
+		buffer_free(s);
+		buffer_free(b);
+	}
+
+	// Large buffers backed by contiguous extents
+	{
+		static uint8_t data[3 * 1024 * 1024 + 77];
+		static uint8_t read[sizeof(data)];
+		for (size_t i = 0; i < sizeof(data); i++)
+		{
+			data[i] = (uint8_t)(i * 5);
+		}
+
+		buffer_t * b = buffer_newlarge(64 * 1024);
+		assert(b != NULL, "Allocate large buffer");
+		assert(buffer_write(b, data, 0, sizeof(data)) == sizeof(data) && buffer_size(b) == sizeof(data), "Grow large buffer");
+		assert(buffer_read(b, read, 0, sizeof(read)) == sizeof(data) && memcmp(data, read, sizeof(data)) == 0, "Read back large buffer");
+
+		buffer_t * d = buffer_dup(b);
+		buffer_t * s = buffer_slice(b, 1000, 5000);
+		uint8_t byte = 0xFF;
+		buffer_write(d, &byte, 1500, 1);
+		buffer_write(s, &byte, 0, 1);
+		assert(buffer_read(b, read, 0, sizeof(read)) == sizeof(data) && memcmp(data, read, sizeof(data)) == 0, "Copy-on-write of large buffer");
+		assert(buffer_read(s, read, 0, sizeof(read)) == 5000 && read[0] == 0xFF && memcmp(&data[1001], &read[1], 4999) == 0, "Copy-on-write of large slice");
+
+		bufferpos_t pos;
+		bufferpos_new(&pos, b, 10);
+		assert(buffer_peek(&pos, 2 * BUFFER_PAGESIZE) != NULL && memcmp(buffer_peek(&pos, 2 * BUFFER_PAGESIZE), &data[10], 2 * BUFFER_PAGESIZE) == 0, "Large buffers peek across pages");
+
+		bufferstats_t stats;
+		buffer_stats(&stats);
+		assert(stats.large_extents == 3 && stats.large_bytes >= 2 * sizeof(data) + 5000, "Large extent statistics");
+
+		buffer_free(s);
+		buffer_free(d);
+		buffer_free(b);
+
+		buffer_stats(&stats);
+		assert(stats.large_extents == 0 && stats.large_bytes == 0, "Large extents released");
+	}
+
+	// Buffers growing past a few MB move to a contiguous extent
+	{
+		static uint8_t data[5 * 1024 * 1024];
+		static uint8_t read[sizeof(data)];
+		for (size_t i = 0; i < sizeof(data); i++)
+		{
+			data[i] = (uint8_t)(i * 3);
+		}
+
+		buffer_t * b = buffer_new();
+		buffer_write(b, data, 0, 3 * BUFFER_PAGESIZE);
+		buffer_t * d = buffer_dup(b);
+
+		bufferstats_t stats;
+		assert(buffer_write(b, data, 0, sizeof(data)) == sizeof(data) && buffer_size(b) == sizeof(data), "Grow buffer past the large threshold");
+		buffer_stats(&stats);
+		assert(stats.large_extents == 1, "Grown buffer moves to an extent");
+		assert(buffer_read(b, read, 0, sizeof(read)) == sizeof(data) && memcmp(data, read, sizeof(data)) == 0, "Read back grown buffer");
+		assert(buffer_read(d, read, 0, sizeof(read)) == 3 * BUFFER_PAGESIZE && memcmp(data, read, 3 * BUFFER_PAGESIZE) == 0, "Growing leaves duplicate intact");
+
+		const size_t far = 3 * 1024 * 1024;
+		uint64_t value = 0x0123456789ABCDEFULL, readback = 0;
+		buffer_t * sparse = buffer_new();
+		buffer_write(sparse, &value, far, sizeof(value));
+		assert(buffer_write(sparse, data, far + sizeof(value), 2 * 1024 * 1024) == 2 * 1024 * 1024, "Grow sparse buffer past the large threshold");
+		assert(buffer_read(sparse, &readback, far, sizeof(readback)) == sizeof(readback) && readback == value, "Growing keeps data behind segment tables");
+		assert(buffer_read(sparse, &readback, far / 2, sizeof(readback)) == sizeof(readback) && readback == 0, "Growing keeps holes as zeros");
+
+		buffer_free(sparse);
+		buffer_free(d);
+		buffer_free(b);
+
+		buffer_stats(&stats);
+		assert(stats.large_extents == 0, "Grown buffer extents released");
+	}
+
+	// Shared references
+	{
+		bufferstats_t before, after;
+		buffer_stats(&before);
+
+		static uint8_t data[2 * BUFFER_PAGESIZE];
+		memset(data, 0x5A, sizeof(data));
+
+		buffer_t * b = buffer_new();
+		buffer_write(b, data, 0, sizeof(data));
+
+		buffer_t * r1 = buffer_ref(b);
+		buffer_t * r2 = buffer_ref(r1);
+		assert(r1 == b && r2 == b && buffer_isshared(b), "Reference shares the handle");
+
+		buffer_free(b);
+		buffer_free(r1);
+		assert(!buffer_isshared(r2) && buffer_read(r2, data, 0, sizeof(data)) == sizeof(data) && data[sizeof(data) - 1] == 0x5A, "Handle outlives dropped references");
+
+		buffer_free(r2);
+		buffer_stats(&after);
+		assert(after.pages_inuse == before.pages_inuse, "Last reference releases the buffer");
+
+		uint64_t storage[BUFFER_INLINESIZE / sizeof(uint64_t)];
+		buffer_t * i = buffer_newinline(storage);
+		buffer_write(i, "abc", 0, 3);
+		buffer_t * ri = buffer_ref(i);
+		assert(ri != NULL && ri != i && !buffer_isinline(ri) && buffer_size(ri) == 3, "Reference to inline buffer is a copy");
+		buffer_free(ri);
+	}
+
+	// Reserve/commit builder and peek
+	{
+		buffer_t * b = buffer_new();
+		bufferpos_t pos;
+		bufferpos_new(&pos, b, 0);
+
+		size_t count = 0;
+		while (pos.offset < 3 * BUFFER_PAGESIZE)
+		{
+			uint32_t * span = buffer_reserve(&pos, sizeof(uint32_t) * 3);
+			if (span == NULL)
+			{
+				// Crossing a page boundary, fall back to a plain write
+				uint32_t values[3] = { count, count, count };
+				bufferpos_write(&pos, values, sizeof(values));
+			}
+			else
+			{
+				span[0] = span[1] = span[2] = count;
+				buffer_commit(&pos, sizeof(uint32_t) * 3);
+			}
+
+			count += 1;
+		}
+
+		assert(buffer_size(b) == count * sizeof(uint32_t) * 3, "Reserve/commit builds buffer");
+
+		bool pass = true;
+		bufferpos_new(&pos, b, 0);
+		for (size_t i = 0; i < count; i++)
+		{
+			uint32_t values[3] = {0};
+			const uint32_t * span = buffer_peek(&pos, sizeof(values));
+			if (span == NULL)
+			{
+				bufferpos_read(&pos, values, sizeof(values));
+				span = values;
+			}
+			else
+			{
+				bufferpos_seek(&pos, sizeof(values), SEEK_CUR);
+			}
+
+			pass &= span[0] == i && span[1] == i && span[2] == i;
+		}
+		assert(pass, "Peek reads back buffer");
+
+		bufferpos_new(&pos, b, buffer_size(b));
+		assert(buffer_peek(&pos, 1) == NULL, "Peek past the end fails");
+
+		// Uncommitted reserves don't leak into later gaps
+		memset(buffer_reserve(&pos, 16), 0xFF, 16);
+		uint8_t byte = 1, gap[16];
+		buffer_write(b, &byte, buffer_size(b) + 32, 1);
+		assert(buffer_read(b, gap, pos.offset, sizeof(gap)) == sizeof(gap) && gap[0] == 0 && gap[15] == 0, "Uncommitted reserve reads as zeros");
+
+		buffer_free(b);
+	}
+
+	// Receive straight into buffer pages
+	{
+		static uint8_t data[3 * BUFFER_PAGESIZE + 321];
+		static uint8_t read[sizeof(data)];
+		for (size_t i = 0; i < sizeof(data); i++)
+		{
+			data[i] = (uint8_t)(i * 11);
+		}
+
+		int fds[2];
+		pipe(fds);
+		write(fds[1], data, 100);
+
+		buffer_t * b = buffer_new();
+		assert(buffer_recv(b, fds[0], 0, 100) == 100 && buffer_read(b, read, 0, sizeof(read)) == 100 && memcmp(data, read, 100) == 0, "Receive into small buffer");
+
+		bufferpos_t pos;
+		bufferpos_new(&pos, b, 100);
+		write(fds[1], &data[100], 2 * BUFFER_PAGESIZE);
+		assert(bufferpos_recv(&pos, fds[0], sizeof(data)) == 2 * BUFFER_PAGESIZE && pos.offset == 100 + 2 * BUFFER_PAGESIZE, "Short receive into large buffer");
+		assert(buffer_size(b) == 100 + 2 * BUFFER_PAGESIZE && buffer_read(b, read, 0, sizeof(read)) == buffer_size(b) && memcmp(data, read, buffer_size(b)) == 0, "Read back received data");
+
+		close(fds[0]);
+		close(fds[1]);
+		buffer_free(b);
+
+		char path[] = "/tmp/test_bufferXXXXXX";
+		int fd = mkstemp(path);
+		write(fd, data, sizeof(data));
+
+		b = buffer_new();
+		assert(buffer_recvfile(b, fd, 0, 50, sizeof(data)) == sizeof(data) - 50, "Receive from file offset");
+		assert(buffer_read(b, read, 0, sizeof(read)) == sizeof(data) - 50 && memcmp(&data[50], read, sizeof(data) - 50) == 0, "Read back file data");
+
+		close(fd);
+		unlink(path);
+		buffer_free(b);
+	}
+
+	// Inline buffers
+	{
+		uint64_t storage[BUFFER_INLINESIZE / sizeof(uint64_t)];
+		buffer_t * b = buffer_newinline(storage);
+		assert(b != NULL && buffer_isinline(b) && buffer_size(b) == 0, "Create inline buffer");
+
+		const double pose[3] = { 1.0, -2.5, 3.25 };
+		double read[3] = {0};
+		assert(buffer_write(b, pose, 0, sizeof(pose)) == sizeof(pose) && buffer_read(b, read, 0, sizeof(read)) == sizeof(read) && memcmp(pose, read, sizeof(pose)) == 0, "Write/read inline buffer");
+		bufferstats_t stats;
+		assert(buffer_write(b, pose, BUFFER_INLINECAPACITY - 1, sizeof(pose)) == 0 && buffer_size(b) == sizeof(pose), "Inline buffer can't grow past its storage");
+		buffer_stats(&stats);
+		assert(stats.inline_overflows == 1, "Inline buffer overflow is counted");
+
+		buffer_t * dup = buffer_dup(b);
+		assert(dup != NULL && !buffer_isinline(dup) && buffer_size(dup) == sizeof(pose), "Dup of inline buffer moves to the pool");
+
+		double value = 0.0;
+		buffer_write(b, &value, 0, sizeof(double));
+		buffer_read(dup, &value, 0, sizeof(double));
+		assert(value == pose[0], "Dup of inline buffer is independent");
+		buffer_free(dup);
+
+		bufferpos_t pos;
+		bufferpos_new(&pos, b, 64);
+		assert(bufferpos_span(&pos) == BUFFER_INLINECAPACITY - 64 && buffer_reserve(&pos, 8) == (uint8_t *)b + sizeof(size_t) + 64, "Reserve in inline buffer");
+		buffer_commit(&pos, 8);
+		assert(buffer_size(b) == 72 && buffer_read(b, &value, 56, sizeof(double)) == sizeof(double) && value == 0.0, "Commit to inline buffer zero-fills the gap");
+
+		buffer_free(b);
+		assert(buffer_size(b) == 72, "Freeing an inline buffer leaves the storage alone");
+	}
+
+	// Concurrent allocation through the thread caches
+	{
+		bool pass = true;
+		pthread_t threads[TEST_THREADS];
+		for (size_t i = 0; i < TEST_THREADS; i++)
+		{
+			pthread_create(&threads[i], NULL, test_buffer_dothread, &pass);
+		}
+
+		for (size_t i = 0; i < TEST_THREADS; i++)
+		{
+			pthread_join(threads[i], NULL);
+		}
+
+		assert(pass, "Concurrent allocate/free from multiple threads");
+	}
+
+	// Exhaust the pool and make sure every page comes back
+	{
+		size_t count = 0;
+		buffer_t * head = NULL;
+		buffer_t * b = NULL;
+		while ((b = buffer_new()) != NULL)
+		{
+			// Chain the buffers through their own payload
+			buffer_write(b, &head, 0, sizeof(buffer_t *));
+			head = b;
+			count += 1;
+		}
+
+		assert(count > 0 && count <= TEST_POOLSIZE / BUFFER_PAGESIZE, "Pool exhausts after all pages are used");
+
+		size_t freed = 0;
+		while (head != NULL)
+		{
+			buffer_t * next = NULL;
+			buffer_read(head, &next, 0, sizeof(buffer_t *));
+			buffer_free(head);
+			head = next;
+			freed += 1;
+		}
+
+		size_t again = 0;
+		buffer_t * all[TEST_POOLSIZE / BUFFER_PAGESIZE];
+		while ((all[again] = buffer_new()) != NULL)
+		{
+			again += 1;
+		}
+
+		for (size_t i = 0; i < again; i++)
+		{
+			buffer_free(all[i]);
+		}
+
+		assert(freed == count && again == count, "All pages returned to the pool");
+
+		bufferstats_t stats;
+		buffer_stats(&stats);
+		assert(stats.alloc_failures >= 2 && stats.pages_highwater == stats.pages_total, "Pool statistics track exhaustion");
+	}
+
+	buffer_destroy();
+
+	// Elastic pool
+	{
+		assert(buffer_init(BUFFER_ARENASIZE, 4 * BUFFER_ARENASIZE, BUFFER_HUGEPAGES, &e) && !exception_check(&e), "Initialize elastic buffer pool");
+
+		bufferstats_t stats;
+		buffer_stats(&stats);
+		assert(stats.arenas == 1 && stats.pages_total == BUFFER_ARENASIZE / BUFFER_PAGESIZE, "Elastic pool starts with one arena");
+
+		size_t count = 0;
+		buffer_t * all[4 * BUFFER_ARENASIZE / BUFFER_PAGESIZE];
+		while ((all[count] = buffer_new()) != NULL)
+		{
+			count += 1;
+		}
+
+		buffer_stats(&stats);
+		assert(stats.arenas == 4 && count == stats.pages_total - 1, "Elastic pool grows to its maximum size");
+		assert(stats.pages_inuse == stats.pages_total, "All pages in use");
+		assert(stats.arenas_huge <= stats.arenas && stats.hugepages == (stats.arenas_huge == stats.arenas), "Statistics report the backing of every arena");
+
+		for (size_t i = 0; i < count; i++)
+		{
+			buffer_free(all[i]);
+		}
+
+		buffer_setwatermarks(0, BUFFER_ARENASIZE);
+		buffer_maintain();
+		buffer_stats(&stats);
+		assert(stats.arenas_huge > 0 || (stats.pages_free - stats.pages_released) <= BUFFER_ARENASIZE / BUFFER_PAGESIZE + 2 * 64, "Memory over the high watermark is given back");
+
+		buffer_t * b = buffer_new();
+		int value = 42;
+		assert(buffer_write(b, &value, 0, sizeof(int)) == sizeof(int) && buffer_read(b, &value, 0, sizeof(int)) == sizeof(int) && value == 42, "Released pages are usable again");
+		buffer_free(b);
+
+		buffer_destroy();
+	}
+
+	// Exhaustion policies
+	{
+		assert(buffer_init(BUFFER_ARENASIZE, BUFFER_ARENASIZE, 0, &e) && !exception_check(&e), "Initialize bounded buffer pool");
+		buffer_setpolicy(NANOS_PER_SECOND / MILLIS_PER_SECOND, 128 * BUFFER_PAGESIZE);
+
+		bufferstats_t stats;
+		buffer_stats(&stats);
+		assert(stats.pages_reserved >= 128, "Emergency reserve set aside");
+
+		while (test_buffer_numheld < nelems(test_buffer_held) && (test_buffer_held[test_buffer_numheld] = buffer_new()) != NULL)
+		{
+			test_buffer_numheld += 1;
+		}
+
+		buffer_stats(&stats);
+		assert(stats.waits > 0 && stats.wait_timeouts > 0, "Non-realtime allocation waits then fails");
+		assert(stats.pages_reserved >= 128, "Non-realtime threads don't touch the emergency reserve");
+
+		bool pass = false;
+		pthread_t thread;
+		pthread_create(&thread, NULL, test_buffer_dorealtime, &pass);
+		pthread_join(thread, NULL);
+
+		buffer_stats(&stats);
+		assert(pass && stats.reserve_allocs == 1, "Realtime allocation draws from the emergency reserve");
+
+		// The realtime thread's cache went back to the pool on exit, use it up again
+		while (test_buffer_numheld < nelems(test_buffer_held) && (test_buffer_held[test_buffer_numheld] = buffer_new()) != NULL)
+		{
+			test_buffer_numheld += 1;
+		}
+
+		// Shrinking the reserve hands pages back to the pool, that must wake a waiting allocator
+		{
+			buffer_setpolicy(10 * NANOS_PER_SECOND, 128 * BUFFER_PAGESIZE);
+
+			struct timespec start, end;
+			clock_gettime(CLOCK_MONOTONIC, &start);
+			pthread_create(&thread, NULL, test_buffer_doshrink, NULL);
+			buffer_t * b = buffer_new();
+			clock_gettime(CLOCK_MONOTONIC, &end);
+			pthread_join(thread, NULL);
+
+			assert(b != NULL && end.tv_sec - start.tv_sec < 5, "Waiting allocation is woken by pages from the reserve");
+			buffer_free(b);
+
+			buffer_setpolicy(NANOS_PER_SECOND / MILLIS_PER_SECOND, 0);
+			while (test_buffer_numheld < nelems(test_buffer_held) && (test_buffer_held[test_buffer_numheld] = buffer_new()) != NULL)
+			{
+				test_buffer_numheld += 1;
+			}
+		}
+
+		size_t before = test_buffer_numheld;
+		assert(buffer_addreclaimer(test_buffer_doreclaim, NULL), "Register reclaimer");
+		buffer_t * b = buffer_new();
+
+		buffer_stats(&stats);
+		assert(b != NULL && test_buffer_numheld < before && stats.reclaimed > 0, "Reclaimer gives memory back on exhaustion");
+		buffer_free(b);
+
+		while (test_buffer_numheld > 0)
+		{
+			buffer_free(test_buffer_held[--test_buffer_numheld]);
+		}
+
+		buffer_destroy();
+	}
+}
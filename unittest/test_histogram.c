@@ -0,0 +1,78 @@
+#include <string.h>
+
+#include <histogram.h>
+
+#include "unittest.h"
+
+void test_histogram()
+{
+	module("Histogram");
+
+	static histogram_t h;
+
+	// Empty histogram
+	{
+		histogram_clear(&h);
+		assert(histogram_count(&h) == 0 && histogram_percentile(&h, 99.0) == 0, "Empty histogram");
+	}
+
+	// Small values are exact
+	{
+		histogram_clear(&h);
+		for (uint64_t v = 0; v < 32; v++)
+		{
+			histogram_record(&h, v);
+		}
+
+		assert(histogram_count(&h) == 32 && h.min == 0 && histogram_max(&h) == 31, "Record small values");
+		assert(histogram_percentile(&h, 50.0) == 15 && histogram_percentile(&h, 100.0) == 31, "Small value percentiles are exact");
+	}
+
+	// Relative precision across magnitudes
+	{
+		bool pass = true;
+		for (uint64_t v = 33; v < (1ULL << 31); v = v * 3 + 1)
+		{
+			histogram_clear(&h);
+			histogram_record(&h, v);
+			histogram_record(&h, v * 2);		// Keep max above v so the bucket limit shows
+
+			uint64_t p = histogram_percentile(&h, 50.0);
+			pass &= p >= v && p - v <= v / HISTOGRAM_SUBBUCKETS;
+		}
+
+		assert(pass, "Percentiles within one sub-bucket");
+	}
+
+	// Distribution
+	{
+		histogram_clear(&h);
+		for (uint64_t i = 1; i <= 10000; i++)
+		{
+			histogram_record(&h, 1000 * i);			// 1us to 10ms, uniform
+		}
+
+		uint64_t p50 = histogram_percentile(&h, 50.0), p99 = histogram_percentile(&h, 99.0);
+		assert(p50 >= 5000000 && p50 <= 5000000 + 5000000 / HISTOGRAM_SUBBUCKETS, "Median of uniform distribution");
+		assert(p99 >= 9900000 && p99 <= 10000000, "99th percentile of uniform distribution");
+		assert(h.sum / h.count == 5000500, "Mean of uniform distribution");
+	}
+
+	// Values past the range are clamped into the last bucket
+	{
+		histogram_clear(&h);
+		histogram_record(&h, 1ULL << 40);
+		assert(histogram_percentile(&h, 50.0) == (1ULL << 40) && h.buckets[HISTOGRAM_BUCKETS - 1] == 1, "Clamp huge values");
+	}
+
+	// Description
+	{
+		histogram_clear(&h);
+		histogram_record(&h, 100);
+		histogram_record(&h, 300);
+
+		char buffer[256] = {0};
+		histogram_desc(&h, buffer, sizeof(buffer));
+		assert(strcmp(buffer, "{ 'count': 2, 'min': 100, 'mean': 200, 'p50': 103, 'p99': 300, 'p999': 300, 'max': 300 }") == 0, "Histogram description");
+	}
+}
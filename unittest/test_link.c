@@ -0,0 +1,229 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <pthread.h>
+
+#include <aul/atomic.h>
+
+#include <maxmodel/model.h>
+#include <buffer.h>
+#include <kernel.h>
+#include <kernel-priv.h>
+
+#include "unittest.h"
+
+#define TEST_POOLSIZE		(1 * 1024 * 1024)		// 1 MB
+#define TEST_WRITES			200000
+
+typedef struct
+{
+	portlist_t ports;
+	port_t port;
+	linklist_t links;
+} test_link_end_t;
+
+typedef struct
+{
+	test_link_end_t out;
+	test_link_end_t in;
+	model_link_t model;
+	iobacking_t * backing;
+	volatile bool done;
+} test_link_t;
+
+
+// Model stubs, the link code only needs the symbols off the model link (ports come from port.c)
+void model_getlink(const model_link_t * link, const model_linksymbol_t ** out, const model_linksymbol_t ** in)
+{
+	*out = &link->out;
+	*in = &link->in;
+}
+
+void model_getlinkmode(const model_link_t * link, model_linkmode_t * mode)
+{
+	*mode = link->mode;
+}
+
+void model_getlinksymbol(const model_linksymbol_t * symbol, const model_linkable_t ** linkable, const char ** name, bool * hasindex, size_t * index)
+{
+	if (linkable != NULL)	*linkable = symbol->linkable;
+	if (name != NULL)		*name = symbol->name;
+	if (hasindex != NULL)	*hasindex = symbol->attrs.indexed;
+	if (index != NULL)		*index = symbol->index;
+}
+
+
+static void test_link_initend(test_link_end_t * end, meta_iotype_t type, const char * name)
+{
+	memset(end, 0, sizeof(test_link_end_t));
+	list_init(&end->ports);
+	list_init(&end->links.inputs);
+	list_init(&end->links.outputs);
+
+	end->port.type = type;
+	strcpy(end->port.name, name);
+	end->port.backing = iobacking_new(T_STRING, NULL);
+	list_add(&end->ports, &end->port.port_list);
+}
+
+static bool test_link_new(test_link_t * test, model_linkmode_t mode)
+{
+	memset(test, 0, sizeof(test_link_t));
+	test_link_initend(&test->out, meta_output, "out");
+	test_link_initend(&test->in, meta_input, "in");
+
+	strcpy(test->model.out.name, "out");
+	strcpy(test->model.in.name, "in");
+	test->model.mode = mode;
+
+	exception_t * e = NULL;
+	test->backing = link_connect(&test->model, T_STRING, &test->out.links, T_STRING, &test->in.links, &e);
+	return test->backing != NULL && !exception_check(&e);
+}
+
+static void test_link_destroy(test_link_t * test)
+{
+	link_destroy(&test->out.links);
+	link_destroy(&test->in.links);
+	iobacking_destroy(test->backing);
+	iobacking_destroy(test->out.port.backing);
+	iobacking_destroy(test->in.port.backing);
+}
+
+static void test_link_format(char * str, size_t seq)
+{
+	// A sequence number followed by a run of one character, both the run and its length change every write
+	int len = sprintf(str, "%08zu:", seq);
+	memset(&str[len], 'a' + (seq % 26), seq % 200 + 1);
+	str[len + seq % 200 + 1] = '\0';
+}
+
+static bool test_link_parse(const char * str, size_t * seq)
+{
+	char expect[AUL_STRING_MAXLEN];
+	if (sscanf(str, "%zu:", seq) != 1)
+	{
+		return false;
+	}
+
+	test_link_format(expect, *seq);
+	return strcmp(str, expect) == 0;
+}
+
+static void * test_link_dowrite(void * object)
+{
+	test_link_t * test = object;
+	char ** str = (char **)iobacking_data(test->out.port.backing);
+
+	for (size_t seq = 1; seq <= TEST_WRITES; seq++)
+	{
+		test_link_format(*str, seq);
+		test->out.port.backing->isnull = false;
+		iobacking_generation(test->out.port.backing) += 1;
+
+		link_dooutputs(&test->out.ports, &test->out.links);
+	}
+
+	atomic_set(test->done, true);
+	return NULL;
+}
+
+static bool test_link_stress(test_link_t * test, size_t * torn, size_t * seen, size_t * last)
+{
+	// Read the link as fast as possible while another thread writes it
+	pthread_t thread;
+	pthread_create(&thread, NULL, test_link_dowrite, test);
+
+	*torn = *seen = *last = 0;
+	bool ordered = true;
+
+	char ** str = (char **)iobacking_data(test->in.port.backing);
+	uint32_t generation = iobacking_generation(test->in.port.backing);
+	while (!atomic_get(test->done))
+	{
+		link_doinputs(&test->in.ports, &test->in.links);
+		if (iobacking_generation(test->in.port.backing) == generation)
+		{
+			// Nothing handed over
+			continue;
+		}
+
+		generation = iobacking_generation(test->in.port.backing);
+
+		size_t seq = 0;
+		if (!test_link_parse(*str, &seq))
+		{
+			*torn += 1;
+			continue;
+		}
+
+		if (seq <= *last)
+		{
+			// Every handover must carry a newer value than the last one (no duplicated or stale frames)
+			ordered = false;
+		}
+
+		*seen += 1;
+		*last = seq;
+	}
+
+	pthread_join(thread, NULL);
+
+	// The last write must come through once the writer has stopped
+	link_doinputs(&test->in.ports, &test->in.links);
+	if (!test_link_parse(*str, last))
+	{
+		*torn += 1;
+	}
+
+	return ordered;
+}
+
+void test_link()
+{
+	module("Link");
+
+	exception_t * e = NULL;
+	assert(buffer_init(TEST_POOLSIZE, TEST_POOLSIZE, 0, &e) && !exception_check(&e), "Initialize buffer pool");
+
+	// Seqlock (default) link under a concurrent writer
+	{
+		test_link_t test;
+		assert(test_link_new(&test, model_linkdefault), "Connect string link");
+		assert(test.out.links.outputs.next != &test.out.links.outputs && list_entry(test.out.links.outputs.next, link_t, link_list)->sync == NULL, "Default string link uses the backing's seqlock");
+
+		size_t torn = 0, seen = 0, last = 0;
+		bool ordered = test_link_stress(&test, &torn, &seen, &last);
+
+		assert(torn == 0, "Seqlock reader never sees a torn string");
+		assert(ordered, "Seqlock reader only takes newer values");
+		assert(seen > 1, "Seqlock reader makes progress while the writer runs");
+		assert(last == TEST_WRITES, "Seqlock reader gets the final value");
+
+		test_link_destroy(&test);
+	}
+
+	// Triple buffered link under a concurrent writer
+	{
+		test_link_t test;
+		assert(test_link_new(&test, model_linktriplebuffer), "Connect triple buffered string link");
+		assert(test.out.links.outputs.next != &test.out.links.outputs && list_entry(test.out.links.outputs.next, link_t, link_list)->sync != NULL, "Triple buffered link shares a sync between both ends");
+
+		size_t torn = 0, seen = 0, last = 0;
+		bool ordered = test_link_stress(&test, &torn, &seen, &last);
+
+		assert(torn == 0, "Triple buffer reader never sees a torn string");
+		assert(ordered, "Triple buffer reader never gets a duplicated or stale frame");
+		assert(seen > 1, "Triple buffer reader makes progress while the writer runs");
+		assert(last == TEST_WRITES, "Triple buffer reader gets the final value");
+
+		// Nothing was published since the last read, so the fresh bit is clear and the input is left alone
+		uint32_t generation = iobacking_generation(test.in.port.backing);
+		link_doinputs(&test.in.ports, &test.in.links);
+		assert(iobacking_generation(test.in.port.backing) == generation, "Triple buffer reader skips a frame it already took");
+
+		test_link_destroy(&test);
+	}
+
+	buffer_destroy();
+}
@@ -0,0 +1,83 @@
+#include <string.h>
+#include <stdlib.h>
+
+#include <aul/hashtable.h>
+#include <aul/mutex.h>
+
+#include <kernel.h>
+#include <kernel-priv.h>
+
+#include "unittest.h"
+
+hashtable_t portkeys;
+mutex_t portkeys_mutex;
+
+
+// Block stubs, the ports here are added by hand
+iterator_t block_ioitr(const block_t * block)
+{
+	unused(block);
+	return -1;
+}
+
+bool block_ionext(iterator_t itr, const meta_blockio_t ** blockio)
+{
+	unused(itr);
+	unused(blockio);
+	return false;
+}
+
+void meta_getblockio(const meta_blockio_t * blockio, const char ** block_name, const char ** io_name, meta_iotype_t * io_type, char * io_sig, const char ** io_desc)
+{
+	unused(blockio);
+	unused(block_name);
+	unused(io_name);
+	unused(io_type);
+	unused(io_sig);
+	unused(io_desc);
+}
+
+
+void test_port()
+{
+	module("Port");
+
+	hashtable_init(&portkeys, hash_str, hash_streq);
+	mutex_init(&portkeys_mutex, M_NORMAL);
+
+	// Interned keys
+	{
+		const portkey_t * a = port_intern("a");
+		assert(a != NULL && a == port_intern("a"), "Interning a name twice gives the same key");
+		assert(port_intern("b") != a && port_intern("b")->slot != a->slot, "Every key gets its own slot");
+	}
+
+	// Ports by handle
+	{
+		portlist_t ports;
+		portlist_init(&ports);
+
+		exception_t * e = NULL;
+		port_add(&ports, meta_input, "a", iobacking_new(T_DOUBLE, NULL), &e);
+		port_add(&ports, meta_input, "b", iobacking_new(T_DOUBLE, NULL), &e);
+		port_add(&ports, meta_output, "b", iobacking_new(T_DOUBLE, NULL), &e);
+		port_add(&ports, meta_output, "c", iobacking_new(T_DOUBLE, NULL), &e);
+
+		portindex_t inputs, outputs;
+		assert(port_makeindex(&ports, meta_input, &inputs, &e) && port_makeindex(&ports, meta_output, &outputs, &e) && !exception_check(&e), "Index ports by key slot");
+
+		assert(port_lookupindex(&inputs, port_intern("a")) == port_lookup(&ports, meta_input, "a"), "Handle finds its input");
+		assert(port_lookupindex(&outputs, port_intern("b")) == port_lookup(&ports, meta_output, "b") && port_lookupindex(&inputs, port_intern("b")) == port_lookup(&ports, meta_input, "b"), "Inputs and outputs of the same name stay apart");
+		assert(port_lookupindex(&inputs, port_intern("c")) == NULL && port_lookupindex(&outputs, port_intern("a")) == NULL, "Handle misses a port of the other type");
+		assert(port_lookupindex(&inputs, port_intern("interned-later")) == NULL, "Handle interned after the index misses");
+
+		portindex_t empty;
+		portlist_t none;
+		portlist_init(&none);
+		assert(port_makeindex(&none, meta_input, &empty, &e) && port_lookupindex(&empty, port_intern("a")) == NULL, "Empty index misses");
+
+		port_destroyindex(&inputs);
+		port_destroyindex(&outputs);
+		port_destroy(&ports);
+	}
+}
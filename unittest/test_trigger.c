@@ -0,0 +1,140 @@
+#include <stdio.h>
+#include <errno.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/syscall.h>
+
+#include <kernel.h>
+#include <kernel-priv.h>
+
+#include "unittest.h"
+
+#define TEST_HZ				100.0
+#define TEST_RUNTIME		(NANOS_PER_SECOND / 500)	// 2 ms every 10 ms
+#define TEST_SECONDS		2
+
+typedef struct
+{
+	trigger_clock_t * clk;
+	bool admitted;
+	size_t updates;
+	double seconds;
+} test_trigger_t;
+
+
+// Kernel stubs, the clock only needs a kobject and a way to switch the calling thread's scheduler (ports come from port.c)
+void * kobj_new(const char * class_name, const char * name, desc_f desc, destructor_f destructor, size_t size)
+{
+	kobject_t * object = malloc(size);
+	memset(object, 0, size);
+	object->class_name = class_name;
+	object->object_name = strdup(name);
+	object->desc = desc;
+	object->destructor = destructor;
+	return object;
+}
+
+kthread_t * kthread_self()
+{
+	return NULL;
+}
+
+bool kthread_setdeadline(uint64_t runtime_nsec, uint64_t period_nsec, exception_t ** err)
+{
+#if defined(SYS_sched_setattr) && defined(SCHED_DEADLINE)
+	struct
+	{
+		uint32_t size;
+		uint32_t sched_policy;
+		uint64_t sched_flags;
+		int32_t sched_nice;
+		uint32_t sched_priority;
+		uint64_t sched_runtime;
+		uint64_t sched_deadline;
+		uint64_t sched_period;
+	} attr;
+
+	memset(&attr, 0, sizeof(attr));
+	attr.size = sizeof(attr);
+	attr.sched_policy = SCHED_DEADLINE;
+	attr.sched_runtime = runtime_nsec;
+	attr.sched_deadline = period_nsec;
+	attr.sched_period = period_nsec;
+
+	if (syscall(SYS_sched_setattr, 0, &attr, 0) != 0)
+	{
+		exception_set(err, errno, "sched_setattr failed: %s", strerror(errno));
+		return false;
+	}
+
+	return true;
+#else
+	exception_set(err, ENOSYS, "SCHED_DEADLINE isn't supported by this build");
+	return false;
+#endif
+}
+
+void kthread_setroundrobin(int priority)
+{
+	unused(priority);
+}
+
+
+static double test_trigger_now()
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec + now.tv_nsec / (double)NANOS_PER_SECOND;
+}
+
+static void * test_trigger_dodeadline(void * object)
+{
+	test_trigger_t * test = object;
+
+	exception_t * e = NULL;
+	test->admitted = trigger_setdeadline(test->clk, TEST_RUNTIME, &e);
+	if (!test->admitted)
+	{
+		printf("SCHED_DEADLINE not available: %s\n", exception_message(e));
+		exception_free(e);
+		return NULL;
+	}
+
+	// The loop kthread_dothread runs for a deadline thread, the trigger is the only thing that yields
+	double start = test_trigger_now();
+	while ((test->seconds = test_trigger_now() - start) < TEST_SECONDS)
+	{
+		while (!trigger_watch(trigger_cast(test->clk))) {}
+		test->updates += 1;
+	}
+
+	return NULL;
+}
+
+void test_trigger()
+{
+	module("Trigger");
+
+	// A clock under SCHED_DEADLINE must run one update every period
+	{
+		test_trigger_t test;
+		memset(&test, 0, sizeof(test_trigger_t));
+		test.clk = trigger_newclock("deadline", TEST_HZ);
+
+		pthread_t thread;
+		pthread_create(&thread, NULL, test_trigger_dodeadline, &test);
+		pthread_join(thread, NULL);
+
+		if (test.admitted)
+		{
+			double rate = test.updates / test.seconds;
+			assert(rate > TEST_HZ * 0.9 && rate < TEST_HZ * 1.1, "Deadline clock runs at its configured rate");
+		}
+		else
+		{
+			assert(true, "Deadline clock runs at its configured rate (skipped, not admitted)");
+		}
+	}
+}
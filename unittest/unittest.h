@@ -17,6 +17,18 @@ void module(const char * modname);
 #define assert(val, desc) __assert((val), (#val), desc)
 void __assert(bool val, const char * valstr, const char * desc);
 
+void bench(const char * desc, double nanos_per_op);
+
+void test_serialize();
+void test_buffer();
+void test_array();
+void test_histogram();
+void test_link();
+void test_trigger();
+void test_port();
+void bench_buffer();
+void bench_array();
+
 
 
 #ifdef __cplusplus